@@ -0,0 +1,157 @@
+
+
+// Load generator for the eval server (see header/server.hpp).
+//
+//   bench-client.out socket [connections] [requests] [pipeline] [exp]
+//
+// Opens `connections` connections and sends `requests` copies of exp
+// over each, keeping up to `pipeline` of them in flight per connection,
+// then reports the throughput and the latency of the requests.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+struct Client {
+    int fd;
+    long sent, received, errors;
+    deque<Clock::time_point> in_flight;
+    string out;                 // requests not yet written
+    bool partial_error;         // reading a line that started with ERROR
+    size_t line_len;            // of the line being read
+};
+
+static int connect_to(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof addr.sun_path - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof addr) < 0) {
+        perror(path);
+        exit(1);
+    }
+    return fd;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s socket [connections] [requests] "
+                "[pipeline] [exp]\n", argv[0]);
+        return 2;
+    }
+    const char *path = argv[1];
+    int connections = argc > 2 ? atoi(argv[2]) : 8;
+    long requests = argc > 3 ? atol(argv[3]) : 10000;
+    long pipeline = argc > 4 ? atol(argv[4]) : 16;
+    string exp = string(argc > 5 ? argv[5] : "(+ 1 2)") + "\n";
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    vector<Client> clients(connections);
+    for (Client &c : clients) {
+        c.fd = connect_to(path);
+        c.sent = c.received = c.errors = 0;
+        c.partial_error = false;
+        c.line_len = 0;
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLOUT;
+        ev.data.ptr = &c;
+        epoll_ctl(ep, EPOLL_CTL_ADD, c.fd, &ev);
+    }
+
+    vector<double> latencies;
+    latencies.reserve(connections * requests);
+    int done = 0;
+    Clock::time_point start = Clock::now();
+    struct epoll_event events[64];
+    char buf[64 * 1024];
+
+    while (done < connections) {
+        int n = epoll_wait(ep, events, 64, -1);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            return 1;
+        }
+        for (int i = 0; i < n; i++) {
+            Client &c = *(Client*)events[i].data.ptr;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)
+                && !(events[i].events & EPOLLIN)) {
+                fprintf(stderr, "connection closed by the server\n");
+                return 1;
+            }
+            if (events[i].events & EPOLLIN) {
+                ssize_t got = read(c.fd, buf, sizeof buf);
+                if (got <= 0) {
+                    fprintf(stderr, "connection closed by the server\n");
+                    return 1;
+                }
+                Clock::time_point now = Clock::now();
+                for (ssize_t k = 0; k < got; k++) {
+                    if (c.line_len++ == 0)
+                        c.partial_error = buf[k] == 'E';
+                    if (buf[k] != '\n')
+                        continue;
+                    latencies.push_back(chrono::duration<double, micro>(
+                        now - c.in_flight.front()).count());
+                    c.in_flight.pop_front();
+                    c.errors += c.partial_error;
+                    c.line_len = 0;
+                    if (++c.received == requests) {
+                        close(c.fd);
+                        done++;
+                    }
+                }
+            }
+            if (c.received == requests)
+                continue;
+
+            Clock::time_point now = Clock::now();
+            while (c.sent < requests
+                   && c.sent - c.received < pipeline) {
+                c.out += exp;
+                c.in_flight.push_back(now);
+                c.sent++;
+            }
+            if (!c.out.empty()) {
+                ssize_t put = write(c.fd, c.out.data(), c.out.size());
+                if (put > 0)
+                    c.out.erase(0, put);
+            }
+            struct epoll_event ev = {};
+            ev.events = EPOLLIN | (c.out.empty() ? 0 : EPOLLOUT);
+            ev.data.ptr = &c;
+            epoll_ctl(ep, EPOLL_CTL_MOD, c.fd, &ev);
+        }
+    }
+
+    double secs = chrono::duration<double>(Clock::now() - start).count();
+    long errors = 0;
+    for (Client &c : clients)
+        errors += c.errors;
+    sort(latencies.begin(), latencies.end());
+    size_t total = latencies.size();
+    printf("%zu requests over %d connections, pipeline %ld: %.3f s, "
+           "%.0f requests/s\n",
+           total, connections, pipeline, secs, total / secs);
+    printf("latency us: p50 %.1f  p99 %.1f  max %.1f\n",
+           latencies[total / 2], latencies[total * 99 / 100],
+           latencies[total - 1]);
+    if (errors)
+        printf("%ld requests failed\n", errors);
+    return errors ? 1 : 0;
+}
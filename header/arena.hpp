@@ -0,0 +1,73 @@
+
+#ifndef ARENA_HEADER
+#define ARENA_HEADER
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Compressed cell references, built with `make COMPRESSED_REFS=1`.
+//
+// Every cell then lives in one arena of address space reserved up front
+// and committed as the heaps grow. The cdr of a cell (its next field)
+// is a 32-bit index into the arena instead of a pointer, and the type and
+// mark bit share the rest of that word, so a cell takes 16 bytes instead
+// of 24 and has no malloc header: a cons costs 16 bytes, not 32. The car
+// stays a full word, as it also holds fixnums, flonums and payloads.
+//
+// Each thread allocates from a free list of its own, refilled
+// ARENA_BATCH cells at a time. Freed cells go on the freeing thread's
+// list and full lists are pooled, so what a parallel sweep frees is
+// reused by whichever thread allocates next.
+//
+// A cell outside the arena, on the C++ stack, cannot be the cdr of
+// another cell in this build; STACK_LISTS (data.hpp) tells the code
+// building argument lists on the stack.
+
+#ifndef LISP_COMPRESSED_REFS
+#define LISP_COMPRESSED_REFS 0
+#endif
+
+#if LISP_COMPRESSED_REFS
+
+#define ARENA_CELL_SIZE 16
+// address space reserved, the most 32-bit indexes reach: 64 GB
+#define ARENA_CELLS (1UL << 32)
+#define ARENA_BATCH 4096
+// committed at a time
+#define ARENA_COMMIT (1024 * 1024)
+
+struct Cell;
+
+extern char *arena_base;
+extern size_t arena_bytes;
+
+void *arena_alloc();
+// n cells in a row, for a run (see data.hpp), freed one by one
+void *arena_alloc_run(size_t n);
+void arena_free(void *cell);
+[[noreturn]] void arena_outside(const void *cell);
+
+// A reference to an arena cell, 0 for NULL. It converts to and from
+// Cell*, so a field of this type reads like a pointer.
+struct CellRef {
+    uint32_t index;
+
+    CellRef(Cell *cell = NULL) {
+        uintptr_t off = (uintptr_t)cell - (uintptr_t)arena_base;
+        if (cell == NULL)
+            index = 0;
+        else if (off < arena_bytes)
+            index = off / ARENA_CELL_SIZE;
+        else
+            arena_outside(cell);
+    }
+    operator Cell*() const {
+        return index ? (Cell*)(arena_base + (size_t)index * ARENA_CELL_SIZE)
+                     : NULL;
+    }
+    Cell *operator->() const { return *this; }
+};
+
+#endif
+
+#endif
@@ -0,0 +1,45 @@
+
+#ifndef BIGNUM_HEADER
+#define BIGNUM_HEADER
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Arbitrary precision integer, sign and magnitude. The magnitude is
+// little endian 32 bit limbs without leading zeros, so zero is empty.
+struct BigInt {
+    bool neg;
+    vector<uint32_t> mag;
+
+    BigInt() : neg(false) {}
+    BigInt(long x);
+
+    static BigInt from_string(const char *digits); // [+-]?[0-9]+
+
+    bool is_zero() const { return mag.empty(); }
+    bool fits_long() const;
+    long to_long() const;
+    double to_double() const;
+    string to_string() const;
+    size_t hash() const;
+
+    BigInt operator-() const;
+    friend BigInt operator+(const BigInt &a, const BigInt &b);
+    friend BigInt operator-(const BigInt &a, const BigInt &b);
+    friend BigInt operator*(const BigInt &a, const BigInt &b);
+
+    // truncating division, remainder takes the sign of a
+    static void divmod(const BigInt &a, const BigInt &b,
+                       BigInt &q, BigInt &r);
+    static BigInt gcd(BigInt a, BigInt b);
+    static int compare(const BigInt &a, const BigInt &b);
+
+    bool operator==(const BigInt &b) const {
+        return neg == b.neg && mag == b.mag;
+    }
+};
+
+#endif
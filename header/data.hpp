@@ -11,38 +11,40 @@
 #include <vector>
 #include <iostream>
 #include <functional>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace std;
 
-#define DEBUG
+#include "log.hpp"
+#include "arena.hpp"
 
-#ifdef DEBUG
-#define debuglog1(msg) printf("%-15s: " msg, __func__)
-#define debuglog(fmt, ...) printf("%-15s: " fmt, __func__, __VA_ARGS__)
-/* #define debuglogln(msg) printf("%-15s: " msg "\n", __func__) */
-
-#define debugObj(cell, msg) (cout << #cell " = " << cell << msg)           
-#define debuglnObj(cell) debugObj(cell, "\n")
-#else
-#define debuglog1(msg)
-#define debuglog(...)
-#define debugObj(msg1, cell)
-#define debuglnObj(cell)
-#endif
+struct Cell;
 
+// Errors are TypeError cells holding a LispError (see error.hpp).
+// Code that returns a Cell* hands them back with return_error; code that
+// cannot (accessors, deep helpers) throws with error, and the exception is
+// turned back into an error cell by apply or eval_toplevel.
 extern std::string Backtrace(int skip = 1);
-#define error(msg, ...) ({                      \
-            cout << Backtrace();                \
-            printf(msg, __VA_ARGS__);           \
-            exit(1);                            \
-        });
-    
+Cell *make_error(const char *where, const char *msg, Cell *irritant);
+
+struct LispException {
+    Cell *err;
+};
+
+#define error(msg, irritant)                                            \
+    throw LispException{make_error(__func__, msg, irritant)}
+
 #define ensure(exp, thetype) ({                                         \
             if (exp->type != thetype) {                                 \
-                return_error("%s is not of type %d", #exp, thetype);    \
+                return_error(#exp " is not of type " #thetype, exp);    \
             }})
 
-enum LispType {
+enum LispType : uint8_t {
     TypeUnknown, // 0
     //
     TypeInt, // 1
@@ -55,13 +57,29 @@ enum LispType {
     TypePair,
     TypePrim,
     TypeError, // 9
-    TypeProcedure
+    TypeProcedure,
+    TypeBigNum,
+    TypeF64Vector,
+    TypeS64Vector,
+    TypeHashTable,
+    TypeStringBuilder,
+    TypeRecordType,
+    TypeRecord,
+    TypeRecordProc,
+    TypePromise,
+    TypeValues,
+    TypePort,
+    TypeEof,
+    TypeFuture,
+    TypeGreenThread,
+    TypeChannel,
+    TypeEnvironment
 };
 
 // Forward declare
 struct Cell;
-struct Procedure;
 struct Environment;
+struct GreenScheduler;
 
 typedef vector<Cell*> List;
 
@@ -73,94 +91,328 @@ typedef vector<Cell*> List;
 
 struct Cell {
 public:
+#if LISP_COMPRESSED_REFS
+    // 16 bytes, in the arena (see arena.hpp)
+    void *val;
+    CellRef next;
     LispType type;
     bool in_use;
+    uint16_t run;
+
+    static void *operator new(size_t) { return arena_alloc(); }
+    static void operator delete(void *cell) { arena_free(cell); }
+#else
+    LispType type;
+    bool in_use;
+    uint16_t run;
     void *val;
     Cell *next;
+#endif
 
-    Cell(LispType type=TypeUnknown, void* val=NULL, Cell* next=nullptr) :
-        type(type), val(val), next(next) {}
+    Cell(LispType type=TypeUnknown, void* val=NULL, Cell* next=nullptr) {
+        this->type = type;
+        this->in_use = false;
+        this->run = 0;
+        this->val = val;
+        this->next = next;
+    }
 
     Cell* car() {
         if (type == TypePair)
             return (Cell*)val;
-        error("CAR used on non pair cell, %d", type);
+        error("CAR used on non pair cell", this);
     }
     Cell* cdr() {
         if (type == TypePair)
             return next;
-        error("CDR used on non pair cell, %d", type);
+        error("CDR used on non pair cell", this);
     }
 
-    // void set_car(Cell *val) { this->val = val; }
+    void set_car(Cell *val) { this->val = val; }
     void set_cdr(Cell *val) { this->next = val; }
 
     void mark();
+    void mark_children();
     void free_cell();
     int count_obj();
 
     friend ostream& operator<<(ostream &out, Cell *exp);
     
-    string as_string() {
-        if (type == TypeString || type == TypeSymbol)
-            return string((char*)(this->val));
-        error("trying to access type %d as string", type);
-    }
+    string as_string();
     // const char* as_char_str() { return (const char*)(this->val); }
     // List& as_list() { return ( *)(this->val); }
 #define DEF_CONVERTER(name, type)                                   \
     type name () { return *reinterpret_cast<type*>(&this->val); }
 
     DEF_CONVERTER(as_char_str, char*)
-    DEF_CONVERTER(as_procedure, Procedure*)
     DEF_CONVERTER(as_cell, Cell*)
     
 #define CONVERT_AS(type) DEF_CONVERTER(as_ ## type, type)
 
     CONVERT_AS(int)
+    CONVERT_AS(long)
     CONVERT_AS(float)
     CONVERT_AS(double)
     // CONVERT_AS(List)
 };
 
+#if LISP_COMPRESSED_REFS
+static_assert(sizeof(Cell) == ARENA_CELL_SIZE, "a cell must fit the arena");
+#endif
+
+// For cells that live outside every heap and are shared by all VMs (nil,
+// the values marker, the standard ports). They count as marked from the
+// start, so no collection ever writes to them.
+inline Cell *permanent(Cell cell) {
+    Cell *x = new Cell(cell);
+    x->in_use = true;
+    return x;
+}
+
+// whether a cell on the C++ stack may be the cdr of another, which a
+// compressed reference cannot point at
+#define STACK_LISTS (!LISP_COMPRESSED_REFS)
+
+// Outside a collection the only marked cells are the permanent ones and
+// those of a frozen template VM (see VM::freeze), which are shared and
+// must not be written to.
+#define is_frozen(x) ((x)->in_use)
+#define check_mutable(x) ({                                             \
+            if (is_frozen(x))                                           \
+                error("object belongs to a frozen template", x);        \
+        })
+
 typedef vector<Cell*> List;
 
+// Lists made by VM::makeList are runs: their pairs are allocated in one
+// piece, each the cdr of the one before, and only the first is in the
+// heap, its run field counting the others. A run costs one allocation
+// and one heap slot instead of one per pair, and walking it reads memory
+// in order. The pairs are ordinary ones, set-car! and set-cdr! work on
+// them as on any other; the run is freed once none of them is reachable,
+// and until then a pair cut off by set-cdr! keeps its place. Longer
+// lists are made of several runs.
+#define RUN_MAX 65536
+// Shorter lists are made of single pairs. In the arena a freed run only
+// comes back as single cells, so the short argument lists that die young
+// would keep taking fresh ones.
+#if LISP_COMPRESSED_REFS
+#define RUN_MIN 8
+#else
+#define RUN_MIN 2
+#endif
+
+#if LISP_COMPRESSED_REFS
+// a 32-bit next field cannot hold the name, it is looked up by function
+const char *prim_name_of(void *fn);
+void set_prim_name(Cell *prim, const char *name);
+#define prim_name(x) (prim_name_of((x)->val))
+#else
 // prim uses next field to store name 
 #define prim_name(x) ((char*)x->next)
-
-struct Procedure {
-public:
-    Cell *param;
-    Cell *body;
-    Environment *env;
-};
+#define set_prim_name(x, name) ((x)->next = (Cell*)(name))
+#endif
 
 // GC code from https://github.com/munificent/lisp2-gc
 
 #define STACK_MAX 256
-#define HEAP_SIZE (1024 * 1024)
 
+// what a heap cell costs: the cell, its malloc header (none in the
+// arena) and its slot in the heap vector
+#if LISP_COMPRESSED_REFS
+#define CELL_BYTES (sizeof(Cell) + sizeof(Cell*))
+#else
+#define CELL_BYTES (sizeof(Cell) + 2 * sizeof(Cell*))
+#endif
+
+// Limits on the size of a VM's heap, in bytes (see heap.hpp).
+struct HeapLimits {
+    size_t min;
+    size_t soft;
+    size_t max;
+    double growth;      // heap allowed after a collection, over survivors
+};
+
+// Hashes and compares C strings by their chars, for the symbol table.
+struct CStrHash {
+    size_t operator()(const char *s) const {
+        size_t h = 14695981039346656037UL;
+        for (; *s; s++)
+            h = (h ^ (unsigned char)*s) * 1099511628211UL;
+        return h;
+    }
+};
+struct CStrEq {
+    bool operator()(const char *x, const char *y) const {
+        return strcmp(x, y) == 0;
+    }
+};
+
+// A task stopped at a safe point (see VM::task_pause): its stack from
+// `from` up to `to`, where it was entered, and the values buffer of its
+// thread if it may be in use.
+struct StoppedTask {
+    void **from;
+    void **to;
+    vector<Cell*> *values;
+};
+
+// the special forms, eval tells them apart by symbol (see
+// special_forms in lisp.hpp)
+enum SpecialForm {
+    FormQuote, FormIf, FormSet, FormLambda, FormDefine, FormTry,
+    FormDefstruct, FormDelay, FormConsStream, FormReceive, FormFuture,
+    FormPcall, FormBegin, FormCount
+};
+
+// An interpreter: its heap, symbol table and global environment. VMs
+// share nothing but the code, so threads each working in their own VM
+// run independently. A VM is used by one thread at a time, apart from
+// the pool workers running tasks it spawned (see pool.hpp).
 struct VM {
+    // Symbols are heap cells, found by name in symbol_table. The table
+    // is weak: a collection drops the symbols nothing else points at,
+    // and interning the name again makes a new one. Those in symbols
+    // are pinned, marked by every collection: nil, t, the names of the
+    // primitives and those of the special forms. nil_symbol, t_symbol
+    // and forms hold on to theirs without the table.
+    unordered_map<const char*, Cell*, CStrHash, CStrEq> symbol_table;
     List symbols;
+    // every cell, environments included but root_env
     vector<Cell*> heap;
     Environment *root_env;
+    // tasks of the VM queued or running on the pool
+    std::atomic<int> in_flight;
+    // guards symbol_table, pending and futures while pool workers share
+    // the VM
+    std::mutex lock;
+    // cells of finished futures, moved into the heap by the VM's thread
+    List pending;
+    // futures whose task has not left the queue, roots until it has
+    std::unordered_set<Cell*> futures;
+    // The VM's thread collects while its tasks run: they stop at a safe
+    // point for it, a procedure call or a wait, and their allocation
+    // buffers are taken into the heap and their stacks scanned as roots.
+    // The fields below are guarded by task_lock.
+    std::mutex task_lock;
+    std::condition_variable task_cv;
+    // tasks that may touch cells right now
+    int tasks_running;
+    // a collection waits for tasks_running to drop to 0
+    std::atomic<bool> stopping;
+    std::vector<StoppedTask*> stopped;
+    // allocation buffers of the tasks in flight
+    std::vector<List*> sinks;
+    // set on the VM's thread while it collects
+    bool collecting;
+    // a task has allocated task_room cells since the last collection and
+    // asks for the next one
+    std::atomic<bool> gc_wanted;
+    std::atomic<size_t> task_room;
+    // "nil" and "t", interned once, both are looked up far too often to
+    // go through symbol_table
+    Cell *nil_symbol;
+    Cell *t_symbol;
+    // the symbols of the special forms, tested by eval on every pair it
+    // evaluates; interning them each time would take the lock while
+    // tasks are in flight
+    Cell *forms[FormCount];
+    // the frozen template this VM was cloned from, if any
+    VM *base;
+    bool frozen;
+    // the green threads of the VM, made on first spawn (see green.hpp)
+    GreenScheduler *green;
+    // limits of the evaluation in progress (see limits.hpp): procedure
+    // calls left, cells allocated so far and how many there may be, and
+    // whether cancel_eval was called
+    std::atomic<long> fuel;
+    long cells_allocated;
+    long cell_limit;
+    std::atomic<bool> cancelled;
+    // the heap is collected once it has gc_threshold cells
+    HeapLimits heap_limits;
+    size_t gc_threshold;
+    // pairs in runs besides the first of each, which heap does not hold
+    std::atomic<size_t> run_cells;
 
     void gc();
-    void freeAll();
+    void mark_stack();
+    // marks every heap cell that a word in [from, to) points at
+    void mark_range(void **from, void **to);
+    // a fresh environment extending parent
+    Environment* makeEnv(Environment *parent);
+    // collects if the heap has reached gc_threshold or a task asked to
+    void reserve();
+    // A task of the VM starts or ends running on the calling thread,
+    // with sink its allocation buffer if it is to be taken into the heap
+    // by collections. Starting waits for a collection in progress, unless
+    // the thread is inside a task of the VM already.
+    void task_enter(List *sink);
+    void task_leave(List *sink);
+    // the allocation buffer of a batch of tasks, until it is merged
+    void add_sink(List *sink);
+    void drop_sink(List *sink);
+    // Runs wait with the calling thread's tasks of the VM stopped at a
+    // safe point, then waits for a collection that started meanwhile to
+    // finish.
+    void task_pause(const function<void()> &wait, bool values);
+    // stops the calling task if a collection is waiting for it
+    void safepoint() {
+        if (stopping.load(std::memory_order_relaxed))
+            task_pause([] {}, true);
+    }
+    // the heap cell or pair of a run that p points at, if any
+    Cell *findCell(void *p);
     Cell* newObject();
+    // a fresh list of n pairs, all nil, allocated as runs
+    Cell* makeList(size_t n);
+    // the cells the heap holds, runs included
+    size_t heapCells() { return heap.size() + run_cells; }
+    // moves pending into the heap, on the VM's own thread
+    void adopt_pending();
     Cell* getSymbol(char const* sym);
     Cell* makeCell(LispType type, void* x, Cell* y);
     // Cell* makeCell(LispType type, Cell* x, Cell* y);
     int numObjs() { return heap.size(); }
 
+    // Makes a warmed up VM a template: collects it, then leaves every
+    // surviving cell and environment marked for good, so that clones can
+    // share them read-only. A frozen VM is not collected again and must
+    // outlive its clones.
+    void freeze();
+
     VM();
+    // A VM on top of the frozen base, in constant time: it shares the
+    // cells, environments and symbols of base, starting with an empty
+    // heap of its own. Its globals start out as those of base; define
+    // and set! on them bind in the clone only, so base never changes.
+    explicit VM(VM *base);
+    // frees every cell, environment and symbol of the VM
+    ~VM();
 };
 
+// When set, newObject records cells here instead of in the VM heap.
+// Tasks on the pool allocate this way (see pool.hpp).
+extern thread_local List *alloc_sink;
+
 #define string_eq(x, y) (strcmp((char *)x, (char *)y) == 0)
 #define cell_type(x) ((x)->type)
 
 Cell *nil(void);
+Cell *true_symbol(void);
+// The VM of the calling thread. A thread that has not picked one with
+// setVM gets a fresh VM of its own the first time it asks, which is
+// freed when the thread exits.
 VM *getVM(void);
+// makes vm the calling thread's VM and returns the previous one
+VM *setVM(VM *vm);
+
+// Switches the calling thread to vm for the scope.
+struct VMScope {
+    VM *prev;
+    VMScope(VM *vm) : prev(setVM(vm)) {}
+    ~VMScope() { setVM(prev); }
+};
 
 // Cell *make_cell(LispType type, void *data);
 // Cell *cons(Cell *x, Cell *y);
@@ -168,7 +420,7 @@ VM *getVM(void);
 #define cons(x, y) (getVM()->makeCell(TypePair, (void*)x, y))
 #define list(x) (cons(x, nil()))
 
-#define lisp_true intern("t")
+#define lisp_true true_symbol()
 #define is_bool(x) (null(x) || (x) == lisp_true)
 
 // #define falsep(x) (null(x))
@@ -186,15 +438,10 @@ inline Cell* cdr(Cell* x) { return x->cdr(); }
 #define caddr(x) (car(cdr(cdr(x))))
 
 
-#define return_error(msg, ...) ({                                       \
-            char str[128];                                              \
-            sprintf(str, "ERROR: %s, " msg,                             \
-                    __func__, __VA_ARGS__);                             \
-            return make_cell(TypeError, strdup(str));                   \
-        })
-/* #define make_error(msg) make_cell(TypeError, (void*)msg) */
+// msg must be a string literal, it is kept as is, not copied
+#define return_error(msg, irritant) return make_error(__func__, msg, irritant)
 
-#define is_atom(x)   ((x)->next == NULL)
+#define is_atom(x)   (!is_pair(x))
 
 #define is_integer(x)(cell_type(x) == TypeInt)
 #define is_float(x)  (cell_type(x) == TypeFloat)
@@ -223,9 +470,6 @@ typedef Cell *(*PrimLispFn)(Cell*);
         })
 
 
-// reader
-extern Cell *lisp_read(FILE *input);
-
 bool null(Cell *x);
 bool is_number(Cell *x);
 
@@ -10,26 +10,37 @@
 //     Cell* val;
 // };
 
-struct Environment {
-    Environment(Environment* parent = nullptr) {
-        this->parent = parent;
-        this->frame = nil();
-    }
-    Environment(VM* vm, vector<pair<const char*, PrimLispFn>> prim_pairs);
+typedef vector<pair<const char*, PrimLispFn>> prim_pairs;
+
+// An environment is a cell of the heap like any other, marked, swept
+// and allocated along with them (see VM::makeEnv): its val is the frame,
+// an alist of bindings, and its next the enclosing environment, NULL
+// for a root. Only the root environment of a VM is outside the heap.
+struct Environment : Cell {
+    Environment(Environment* parent = nullptr) :
+        Cell(TypeEnvironment, nil(), parent) {}
+    Environment(VM* vm, prim_pairs prims);
 
     Cell* operator [](Cell* const sym);
     Cell* add(Cell* const sym, Cell* val);
+    void add_prims(VM* vm, prim_pairs prims);
 
 public:
-    Environment* parent;
-    Cell* frame;
+    Cell* frame() { return (Cell*)this->val; }
+    void set_frame(Cell* frame) { this->val = frame; }
+    Environment* parent() { return (Environment*)(Cell*)this->next; }
 
-    void mark();
     int count_obj();
-    bool is_root() { return this->parent == nullptr; }
-    Environment* extend() { return new Environment(this); }
+    bool is_root() { return this->parent() == nullptr; }
+    Environment* extend();
 };
 
+// A procedure is a cell holding (param . body) and, as its next, the
+// environment it closes over (see make_procedure).
+#define proc_param(x) (car((x)->as_cell()))
+#define proc_body(x)  (cdr((x)->as_cell()))
+#define proc_env(x)   ((Environment*)(Cell*)(x)->next)
+
 /* typedef struct { */
 /*     Cell *frames; */
 /*     Cell *root; */
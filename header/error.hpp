@@ -0,0 +1,35 @@
+
+#ifndef ERROR_HEADER
+#define ERROR_HEADER
+
+#include "data.hpp"
+#include "env.hpp"
+
+#define ERROR_TRACE_MAX 16
+
+extern std::string SymbolizeFrames(void *const *callstack, int nFrames,
+                                   int skip = 0);
+
+// Payload of a TypeError cell. Creating one records where it was raised
+// and the raw return addresses only; nothing is formatted or symbolized
+// until the error is printed.
+struct LispError {
+    const char *where;          // function that raised it
+    const char *msg;            // static text, or the chars of tag
+    Cell *tag;                  // symbol/string given to (error ...), or nil
+    Cell *irritant;             // offending object, or nil
+    int depth;
+    void *frames[ERROR_TRACE_MAX];
+
+    string backtrace() { return SymbolizeFrames(frames, depth); }
+    void mark();
+};
+
+#define as_error(x) ((LispError*)(x)->val)
+
+// raise from code that cannot return an error cell
+[[noreturn]] void throw_error(Cell *err);
+
+prim_pairs error_prims();
+
+#endif
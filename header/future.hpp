@@ -0,0 +1,47 @@
+
+#ifndef FUTURE_HEADER
+#define FUTURE_HEADER
+
+#include <atomic>
+#include "data.hpp"
+#include "env.hpp"
+
+// Futures on the work-stealing scheduler (see pool.hpp).
+//
+//   (future exp)        starts evaluating exp on the pool, returns a future
+//   (touch x)           the value of future x, anything else is itself
+//   (pcall f a b ...)   (f a b ...) with the operands evaluated in parallel
+//
+// Touching a future no worker has started yet evaluates it right there;
+// one that is running elsewhere is waited for by running other tasks
+// meanwhile, so recursive divide and conquer code can spawn and touch
+// from inside futures without tying up threads. A future's expression
+// should not define or set! variables another thread may be using.
+
+enum FutureState { FuturePending, FutureRunning, FutureDone };
+
+// Payload of a TypeFuture cell.
+struct Future {
+    Cell *exp;                  // until done
+    Environment *env;
+    VM *vm;
+    std::atomic<int> state;
+    Cell *value;                // once done
+    List cells;                 // allocated while running
+
+    Future(Cell *exp, Environment *env, VM *vm) :
+        exp(exp), env(env), vm(vm), state(FuturePending), value(nil()) {}
+    void mark();
+};
+
+#define is_future(x) (cell_type(x) == TypeFuture)
+#define as_future(x) ((Future*)(x)->val)
+
+Cell *touch(Cell *x);
+
+Cell *eval_future(Cell *exp, Environment *env);
+Cell *eval_pcall(Cell *exp, Environment *env);
+
+prim_pairs future_prims();
+
+#endif
@@ -0,0 +1,101 @@
+
+#ifndef GREEN_HEADER
+#define GREEN_HEADER
+
+#include <deque>
+#include <ucontext.h>
+#include "data.hpp"
+#include "env.hpp"
+
+// Green threads and channels, scheduled by the VM on the thread using it.
+//
+//   (spawn thunk)       starts a green thread calling thunk, returns it
+//   (yield)             lets the other ready green threads run
+//   (join thread)       waits for thread, the value of its thunk
+//   (make-channel [n])  a channel buffering up to n values, 1 by default
+//   (send ch x)         waits while ch is full
+//   (recv ch)           waits while ch is empty
+//
+// Green threads are coroutines: one runs at a time and only gives way
+// in yield, join, send, recv or a read that has to wait. They are
+// driven by the VM's own stack, which runs them whenever it waits for
+// one of these itself; a blocked wait there with no green thread left
+// to run is an error rather than a hang. A read from a pipe or socket
+// that has no data parks the green thread until poll(2) says there is.
+//
+// Each green thread runs on a GREEN_STACK_SIZE stack mapped without
+// reserving memory, so it costs the pages it has touched, a few
+// kilobytes for most, and a guard page catches overflow. The collector
+// scans the stacks of the suspended threads along with the current one.
+
+#define GREEN_STACK_SIZE (1024 * 1024)
+
+enum GreenState { GreenReady, GreenRunning, GreenBlocked, GreenDone };
+
+// Payload of a TypeGreenThread cell.
+struct GreenThread {
+    ucontext_t ctx;             // saved registers while switched out
+    char *stack;                // NULL once done
+    void **sp;                  // deepest live word while switched out
+    GreenState state;
+    Cell *thunk;
+    Cell *result;
+    size_t slot;                // in GreenScheduler::threads
+    // green threads waiting in join
+    vector<GreenThread*> joiners;
+    // while parked on a read, see green_wait_fd
+    int wait_fd;
+    short wait_events;
+
+    GreenThread(Cell *thunk);
+    ~GreenThread();
+    void release_stack();
+    void **stack_top() { return (void**)(stack + GREEN_STACK_SIZE); }
+    void mark();
+};
+
+// Payload of a TypeChannel cell.
+struct Channel {
+    size_t cap;
+    std::deque<Cell*> items;
+    // green threads waiting for room or for items
+    std::deque<GreenThread*> senders, receivers;
+
+    Channel(size_t cap) : cap(cap) {}
+    void mark();
+};
+
+#define is_green_thread(x) (cell_type(x) == TypeGreenThread)
+#define as_green_thread(x) ((GreenThread*)(x)->val)
+#define is_channel(x) (cell_type(x) == TypeChannel)
+#define as_channel(x) ((Channel*)(x)->val)
+
+// The green threads of a VM.
+struct GreenScheduler {
+    std::deque<GreenThread*> ready;
+    // parked until their fd is ready
+    vector<GreenThread*> io_waiting;
+    // cells of the unfinished threads, which are roots
+    List threads;
+    GreenThread *current;       // NULL on the VM's own stack
+    ucontext_t vm_ctx;          // the VM's stack while a thread runs
+    void **vm_sp;
+
+    GreenScheduler() : current(NULL), vm_sp(NULL) {}
+};
+
+// Top of the green thread stack the VM is running on, NULL when it is
+// on the thread's own stack.
+void **green_stack_top(VM *vm);
+// Marks the unfinished threads and scans the stacks not in use: those
+// of the suspended threads, and the VM's own, up to vm_stack_top, while
+// a thread runs.
+void green_mark_roots(VM *vm, void **vm_stack_top);
+// Waits until fd is ready for events (POLLIN, POLLOUT), parking the
+// calling green thread, or running the others when called from the VM's
+// own stack. Returns right away when there are no green threads.
+void green_wait_fd(int fd, short events);
+
+prim_pairs green_prims();
+
+#endif
@@ -0,0 +1,74 @@
+
+#ifndef HASHTABLE_HEADER
+#define HASHTABLE_HEADER
+
+#include "data.hpp"
+#include "env.hpp"
+
+// Chained hash table behind a TypeHashTable cell, keyed by eq (identity)
+// or equal (structure). Growing never rehashes everything at once: a
+// second bucket array is allocated and every later operation moves a few
+// buckets over, so the cost of a resize is spread across the calls that
+// follow it.
+
+enum HashKind { HashEq, HashEqual };
+
+struct HashEntry {
+    Cell *key;
+    Cell *val;
+    size_t hash;
+    HashEntry *next;
+};
+
+struct HashTable {
+    HashKind kind;
+    size_t count;
+    // buckets[0] is the live array, buckets[1] the one being filled
+    // while rehashing; rehash_idx is the next bucket of [0] to move
+    vector<HashEntry*> buckets[2];
+    size_t rehash_idx;
+
+    HashTable(HashKind kind);
+    ~HashTable();
+
+    HashEntry *find(Cell *key);
+    void put(Cell *key, Cell *val);
+    bool remove(Cell *key);
+    void clear();
+    void mark();
+    // moves every entry into place, so that find no longer writes
+    void finish_rehash();
+
+    // calls fn on every entry, in no particular order; fn may delete it
+    template<typename Fn> void each(Fn fn) {
+        for (int t = 0; t < 2; t++) {
+            for (HashEntry *e : buckets[t]) {
+                while (e) {
+                    HashEntry *next = e->next;
+                    fn(e);
+                    e = next;
+                }
+            }
+        }
+    }
+
+private:
+    size_t hash(Cell *key);
+    bool same(Cell *x, Cell *y);
+    bool rehashing() { return !buckets[1].empty(); }
+    void rehash_step(int n);
+    HashEntry **slot(Cell *key, size_t h);
+};
+
+#define is_hashtable(x) (cell_type(x) == TypeHashTable)
+#define as_hashtable(x) ((HashTable*)(x)->val)
+
+Cell *make_hashtable(HashKind kind);
+
+size_t eq_hash(Cell *x);
+// consistent with equal, cycles are cut off by a depth bound
+size_t equal_hash(Cell *x);
+
+prim_pairs hashtable_prims();
+
+#endif
@@ -0,0 +1,47 @@
+
+#ifndef HEAP_HEADER
+#define HEAP_HEADER
+
+#include "data.hpp"
+#include "env.hpp"
+
+// Heap sizing. A VM collects once its heap reaches gc_threshold, which
+// each collection sets to `growth` times the bytes that survived it:
+// a heap that keeps most of its cells grows, one that is mostly garbage
+// shrinks back, and the cost of collecting stays proportional to what
+// is allocated. The threshold is kept within the limits of the VM:
+//
+//   min   never collect a heap smaller than this
+//   soft  past this, collect whenever the heap has grown by an eighth,
+//         trading throughput for a smaller footprint
+//   max   past this, even after collecting, allocation raises an error
+//         tagged out-of-memory (with a little room kept for handling it)
+//
+// Sizes count CELL_BYTES per cell, pairs in runs included though they
+// cost less (see VM::makeList), not the payloads (string chars, vector
+// elements, hash tables) cells own. When a collection frees most of a
+// large heap, the memory goes back to the system.
+//
+// The defaults are read once from the environment, as bytes with an
+// optional k, m or g suffix: LISP_HEAP_MIN, LISP_HEAP_SOFT, LISP_HEAP_MAX
+// and LISP_GC_GROWTH (a factor, 2 by default). A VM cloned from a
+// template starts with the limits of the template.
+//
+//   (heap-limits)                  (min soft max) of the VM, in bytes
+//   (set-heap-limits! min soft max)  nil leaves a limit as it is
+//   (heap-size)                    bytes of cells in the heap now
+
+#define HEAP_MIN_DEFAULT (8L * 1024 * 1024)
+#define HEAP_SOFT_DEFAULT (256L * 1024 * 1024)
+#define HEAP_MAX_DEFAULT (1024L * 1024 * 1024)
+#define GC_GROWTH_DEFAULT 2.0
+
+// the limits set by the environment, or the defaults
+HeapLimits default_heap_limits();
+
+// the heap size, in cells, to collect at with live cells surviving
+size_t next_gc_threshold(const HeapLimits &limits, size_t live);
+
+prim_pairs heap_prims();
+
+#endif
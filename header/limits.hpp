@@ -0,0 +1,72 @@
+
+#ifndef LIMITS_HEADER
+#define LIMITS_HEADER
+
+#include <limits.h>
+#include "data.hpp"
+#include "env.hpp"
+
+// Bounds on an evaluation, for running code that cannot be trusted to
+// finish.
+//
+//   (with-limits fuel cells thunk)  calls thunk with at most fuel
+//                                   procedure calls and cells allocated,
+//                                   nil for no limit on either
+//
+// Every procedure call costs a unit of the VM's fuel and checks the
+// limits, recursion being the only way to loop. A call past a limit
+// returns an error instead, tagged out-of-fuel, out-of-cells or
+// cancelled, which try can catch outside the with-limits. Calls also
+// fail, tagged too-deep, once the C++ stack is within STACK_MARGIN of
+// its end, whatever the limits. Limits nest:
+// the inner one is cut down to what the outer one has left and what it
+// uses is charged to the outer one. Calls made by futures count too;
+// their cells only count once the VM has taken them into its heap.
+// Another thread (or a signal handler) stops the evaluation in progress
+// with cancel_eval.
+
+#define NO_LIMIT LONG_MAX
+// room kept at the end of a stack for the calls failing there
+#define STACK_MARGIN (256 * 1024)
+
+// Calls made with the stack below this fail. Found out on a thread's
+// first call, and moved by the green threads to their own stacks.
+extern thread_local char *stack_floor;
+char *thread_stack_floor();
+
+// whether the calling thread's stack is down to its last STACK_MARGIN,
+// where recursion has to stop
+inline bool stack_exhausted() {
+    if (stack_floor == NULL)
+        stack_floor = thread_stack_floor();
+    return (char*)__builtin_frame_address(0) < stack_floor;
+}
+
+// the error for the limit vm is past
+Cell *limit_error(VM *vm);
+
+// NULL while the calling thread's VM is within its limits, else an
+// error cell saying which one it is past. Charges one unit of fuel.
+inline Cell *charge_call() {
+    VM *vm = getVM();
+    // a call is where a task stops for its VM to collect
+    if (alloc_sink)
+        vm->safepoint();
+    if (vm->fuel.fetch_sub(1, std::memory_order_relaxed) > 0
+        && !stack_exhausted()
+        && !vm->cancelled.load(std::memory_order_relaxed)
+        && (alloc_sink || vm->cells_allocated <= vm->cell_limit))
+        return NULL;
+    return limit_error(vm);
+}
+
+// eval_toplevel within the limits, a pending cancel_eval is dropped
+Cell *eval_limited(Cell *exp, Environment *env, long fuel, long cells);
+// Makes the next procedure call of vm's evaluation fail, from any
+// thread or a signal handler. It stays cancelled until the next
+// eval_limited.
+void cancel_eval(VM *vm);
+
+prim_pairs limits_prims();
+
+#endif
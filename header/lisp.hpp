@@ -6,7 +6,19 @@
 #include "env.hpp"
 
 Cell *eval(Cell *x, Environment *env);
+// eval, with raised errors returned as error cells
+Cell *eval_toplevel(Cell *x, Environment *env);
+// evaluates each of exps, the value of the last one
+Cell *eval_sequence(Cell *exps, Environment *env);
 Cell *apply(Cell *func, Cell *args);
+// apply with one or two arguments; procedures get their argument list
+// on the C++ stack, only primitives (which may keep it) get a fresh one
+Cell *apply1(Cell *func, Cell *x);
+Cell *apply2(Cell *func, Cell *x, Cell *y);
+
+// names of the special forms in the order of SpecialForm, NULL
+// terminated; a VM interns and pins them once (see VM::forms)
+extern const char *special_forms[];
 
 #endif
 
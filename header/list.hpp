@@ -0,0 +1,44 @@
+
+#ifndef LIST_PRIMS_HEADER
+#define LIST_PRIMS_HEADER
+
+#include "data.hpp"
+#include "env.hpp"
+#include "values.hpp"
+
+// List utilities as iterative primitives: append, reverse, length, map,
+// for-each, filter, fold, fold-right, assoc, assq, member, memq and a
+// stable merge sort. None of them recurse on the C++ stack, and calls to
+// a function argument go through apply1 / apply2.
+
+// the value of a callback, returning early when it is an error
+#define check_result(exp) ({                                            \
+            Cell *_result = (exp);                                      \
+            if (is_error(_result))                                      \
+                return _result;                                         \
+            first_value(_result);                                       \
+        })
+
+// Builds a list front to back into runs (see VM::makeList), each twice
+// as long as the one before up to RUN_MAX. The last run is cut down to
+// what it holds when done, so little is allocated twice. The head is a
+// dummy pair on the C++ stack, the list proper starts at its cdr.
+struct RunBuilder {
+    Cell head = Cell(TypePair, NULL, nil());
+    // the last pair added and the one before the run being filled
+    Cell *tail = &head;
+    Cell *before = &head;
+    Cell *run = NULL;
+    size_t used = 0;
+    size_t size = 0;
+
+    void add(Cell *x);
+    Cell *result();
+};
+
+// first pair of alist whose car is equal to key, or nil
+Cell *assoc_equal(Cell *key, Cell *alist);
+
+prim_pairs list_prims();
+
+#endif
@@ -0,0 +1,46 @@
+
+#ifndef LOG_HEADER
+#define LOG_HEADER
+
+#include <stdio.h>
+
+// Log levels, picked at build time with -DLOG_LEVEL=n (see Makefile).
+// Anything above the selected level compiles to nothing.
+#define LOG_NONE  0
+#define LOG_ERROR 1
+#define LOG_INFO  2
+#define LOG_DEBUG 3
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_NONE
+#endif
+
+#if LOG_LEVEL >= LOG_ERROR
+#define errorlog(fmt, ...) fprintf(stderr, "%-15s: " fmt, __func__, __VA_ARGS__)
+#else
+#define errorlog(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_INFO
+#define infolog(fmt, ...) printf("%-15s: " fmt, __func__, __VA_ARGS__)
+#else
+#define infolog(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_DEBUG
+#define debuglog1(msg) printf("%-15s: " msg, __func__)
+#define debuglog(fmt, ...) printf("%-15s: " fmt, __func__, __VA_ARGS__)
+// continues a line started by debuglog, without the function prefix
+#define debuglograw(fmt, ...) printf(fmt, __VA_ARGS__)
+
+#define debugObj(cell, msg) (cout << #cell " = " << cell << msg)
+#define debuglnObj(cell) debugObj(cell, "\n")
+#else
+#define debuglog1(msg) ((void)0)
+#define debuglog(...) ((void)0)
+#define debuglograw(...) ((void)0)
+#define debugObj(cell, msg) ((void)0)
+#define debuglnObj(cell) ((void)0)
+#endif
+
+#endif
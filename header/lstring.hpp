@@ -0,0 +1,46 @@
+
+#ifndef LSTRING_HEADER
+#define LSTRING_HEADER
+
+#include "data.hpp"
+#include "env.hpp"
+
+// Payload of a TypeString cell. The length is stored, and an owned
+// string keeps its chars in the same allocation, right after this header
+// and NUL terminated. A substring view instead points into the chars of
+// `base`, which the GC keeps alive through the view; its chars are not
+// terminated, use lstring_copy when a C string is needed.
+struct LispString {
+    size_t len;
+    char *chars;
+    Cell *base;                 // string a view shares chars with, or NULL
+
+    bool is_view() { return base != NULL; }
+};
+
+// views shorter than this are copied, pinning a large base string is not
+// worth saving a few bytes
+#define STRING_VIEW_MIN 16
+
+#define as_lstring(x) ((LispString*)(x)->val)
+#define string_len(x) (as_lstring(x)->len)
+#define string_chars(x) (as_lstring(x)->chars)
+
+Cell *make_string(const char *chars, size_t len);
+Cell *make_string(const char *str);
+// chars [start, end) of str, sharing storage when it is long enough
+Cell *make_substring(Cell *str, size_t start, size_t end);
+bool string_equal(Cell *x, Cell *y);
+// a NUL terminated copy of the chars; str is left as it is, a view may
+// be shared with other threads through a frozen template
+string lstring_copy(Cell *str);
+void free_lstring(LispString *str);
+
+// A growable buffer behind a TypeStringBuilder cell. Appends are
+// amortized O(1); string-builder->string copies once at the end.
+#define is_string_builder(x) (cell_type(x) == TypeStringBuilder)
+#define as_string_builder(x) ((string*)(x)->val)
+
+prim_pairs string_prims();
+
+#endif
@@ -0,0 +1,49 @@
+
+#ifndef NUMBER_HEADER
+#define NUMBER_HEADER
+
+#include "data.hpp"
+#include "env.hpp"
+#include "bignum.hpp"
+
+// The numeric tower: fixnums (TypeInt, a long kept in val), bignums,
+// exact ratios and floats (a double kept in val). Results are always
+// normalized, a bignum that fits a long is returned as a fixnum and a
+// ratio with denominator 1 as an integer, so equal values have equal
+// representations.
+
+// den > 0 and gcd(num, den) == 1
+struct Ratio {
+    BigInt num;
+    BigInt den;
+};
+
+#define is_bignum(x) (cell_type(x) == TypeBigNum)
+#define is_exact_integer(x) (is_integer(x) || is_bignum(x))
+#define as_bignum(x) ((BigInt*)(x)->val)
+#define as_ratio(x) ((Ratio*)(x)->val)
+
+// branch free check for the fixnum fast paths
+#define both_fixnum(a, b) (((a)->type == TypeInt) & ((b)->type == TypeInt))
+
+Cell *make_fixnum(long n);
+Cell *make_flonum(double d);
+Cell *make_integer(const BigInt &n);
+Cell *make_rational(BigInt num, BigInt den);
+
+Cell *num_add(Cell *a, Cell *b);
+Cell *num_sub(Cell *a, Cell *b);
+Cell *num_mul(Cell *a, Cell *b);
+Cell *num_div(Cell *a, Cell *b);
+// -1, 0 or 1, 2 when unordered (NaN)
+int num_compare(Cell *a, Cell *b);
+double num_to_double(Cell *x);
+
+// same type numbers only, as used by equal
+bool num_equal(Cell *a, Cell *b);
+// consistent with num_equal
+size_t num_hash(Cell *x);
+
+prim_pairs number_prims();
+
+#endif
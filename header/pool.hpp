@@ -0,0 +1,103 @@
+
+#ifndef POOL_HEADER
+#define POOL_HEADER
+
+#include "data.hpp"
+#include "env.hpp"
+
+// A work-stealing scheduler over a fixed set of worker threads, started
+// on first use. LISP_WORKERS overrides the worker count, which defaults
+// to one less than the number of cores.
+//
+// Every worker has a deque of tasks: it runs its own newest first and,
+// when that is empty, steals the oldest task of another worker. Tasks
+// spawned from outside the pool go to a shared queue. A thread waiting
+// for a result runs other tasks meanwhile (help_until), so fork-join code
+// that spawns and waits from inside tasks keeps every core busy.
+//
+// Lisp tasks run in the VM that spawned them and allocate into a list of
+// their own, the thread-local allocation buffer, instead of the VM heap.
+// Only the VM's own thread ever touches the heap vector. It collects
+// while tasks are in flight by stopping them at their next procedure
+// call or wait (see VM::task_pause); a task that has allocated its share
+// of the room left asks it to, and the VM's thread collects from
+// help_until too when it is waiting for its tasks.
+
+// threads a batch is spread over, the caller included
+size_t pool_size();
+
+// Queues task on the scheduler. With no workers it runs right away.
+void spawn(function<void()> task);
+
+// Runs queued tasks on the calling thread until done() holds. A task
+// calling it is stopped at a safe point meanwhile.
+void help_until(const function<bool()> &done);
+
+// Runs task(0) .. task(n-1) on the workers and the calling thread, and
+// returns once all of them are done. The first error raised by a task is
+// raised again from here. The cells the tasks allocated end up where the
+// caller allocates.
+void parallel_run(size_t n, const function<void(size_t)> &task);
+
+// First position of a in the stable merge of a[0, m) and b[0, n) that
+// does not land in the first k outputs, ties going to a.
+template<typename T, typename Less>
+size_t co_rank(size_t k, const T *a, size_t m, const T *b, size_t n,
+                      Less &less) {
+    size_t lo = k > n ? k - n : 0, hi = min(k, m);
+    while (lo < hi) {
+        size_t i = lo + (hi - lo) / 2, j = k - i;
+        if (j > 0 && i < m && !less(b[j - 1], a[i]))
+            lo = i + 1;
+        else
+            hi = i;
+    }
+    return lo;
+}
+
+// Sorts runs of at least `cutoff` elements on separate threads, then
+// merges them pairwise. Every merge round is cut into as many pieces as
+// there are threads, by co-ranking the output, so the last rounds are
+// as parallel as the first. Stable.
+template<typename T, typename Less>
+void parallel_sort(T *data, size_t n, Less less, size_t cutoff) {
+    size_t runs = min(pool_size(), n / cutoff);
+    if (runs <= 1) {
+        stable_sort(data, data + n, less);
+        return;
+    }
+
+    vector<size_t> bounds(runs + 1);
+    for (size_t i = 0; i <= runs; i++)
+        bounds[i] = n * i / runs;
+    parallel_run(runs, [&](size_t i) {
+        stable_sort(data + bounds[i], data + bounds[i + 1], less);
+    });
+
+    vector<T> tmp(n);
+    T *src = data, *dst = tmp.data();
+    for (size_t width = 1; width < runs; width *= 2) {
+        size_t pairs = (runs + 2 * width - 1) / (2 * width);
+        size_t pieces = max((size_t)1, pool_size() / pairs);
+        parallel_run(pairs * pieces, [&](size_t t) {
+            size_t pair = t / pieces, piece = t % pieces;
+            size_t lo = bounds[pair * 2 * width];
+            size_t mid = bounds[min(pair * 2 * width + width, runs)];
+            size_t hi = bounds[min(pair * 2 * width + 2 * width, runs)];
+            const T *a = src + lo, *b = src + mid;
+            size_t m = mid - lo, len = hi - lo;
+            size_t k0 = len * piece / pieces, k1 = len * (piece + 1) / pieces;
+            size_t i0 = co_rank(k0, a, m, b, hi - mid, less);
+            size_t i1 = co_rank(k1, a, m, b, hi - mid, less);
+            merge(a + i0, a + i1, b + (k0 - i0), b + (k1 - i1),
+                  dst + lo + k0, less);
+        });
+        swap(src, dst);
+    }
+    if (src != data)
+        copy(src, src + n, data);
+}
+
+prim_pairs parallel_prims();
+
+#endif
@@ -0,0 +1,88 @@
+
+#ifndef PORT_HEADER
+#define PORT_HEADER
+
+#include "data.hpp"
+#include "env.hpp"
+
+// Buffered byte ports over file descriptors.
+//
+// An input port on a regular file maps the whole file and reads straight
+// out of the mapping; anything else (a pipe, a terminal) is read into a
+// PORT_BUFFER_SIZE buffer a block at a time. An output port collects
+// writes in its buffer and hands them to write(2) when it fills, on
+// flush-output and on close. A port that is collected is closed.
+//
+//   (open-input-file path)          (open-output-file path [append?])
+//   (open-input-string str)         (close-port port)
+//   (read-line [port])              (read-bytes n [port])
+//   (read [port])                   the next s-expression
+//   (write x [port])                (display x [port])
+//   (newline [port])                (flush-output [port])
+//
+// The readers return the eof object at end of input.
+//
+// The standard ports are shared by every VM, so a port serializes its
+// users: writes and flushes take its lock, and so does each read as a
+// whole (read-line, read-bytes, read). getc, peek and unget leave it to
+// the caller.
+
+#define PORT_BUFFER_SIZE (64 * 1024)
+
+// Payload of a TypePort cell.
+struct Port {
+    int fd;                     // -1 for a string port
+    bool input;
+    bool close_fd;              // false for the standard streams
+    bool mapped;                // buf is an mmap of the whole file
+    bool closed;
+    char *buf;
+    // input: the unread bytes are buf[pos, end)
+    // output: buf[0, end) is waiting to be written
+    size_t pos, end, cap;
+    string name;
+    // recursive, a read holds it across the fills it makes
+    std::recursive_mutex lock;
+
+    Port(int fd, bool input, bool close_fd, const string &name);
+    ~Port();
+
+    int getc() {
+        return pos < end || fill() ? (unsigned char)buf[pos++] : EOF;
+    }
+    int peek() {
+        return pos < end || fill() ? (unsigned char)buf[pos] : EOF;
+    }
+    // steps back over the byte the last getc returned
+    void unget() { pos--; }
+    // refills an empty input buffer, false at end of input
+    bool fill();
+    // up to n bytes into out, fewer only at end of input
+    size_t read(string &out, size_t n);
+    // the next line without its newline, false at end of input
+    bool read_line(string &out);
+
+    void write(const char *data, size_t len);
+    void flush();
+    void close();
+
+private:
+    // writes out buf[0, end), with the lock held
+    void drain();
+};
+
+#define is_port(x) (cell_type(x) == TypePort)
+#define as_port(x) ((Port*)(x)->val)
+
+Cell *eof_object();
+#define is_eof_object(x) ((x) == eof_object())
+
+// an input port reading a copy of chars
+Port *new_string_port(const char *chars, size_t len);
+Cell *stdin_port();
+Cell *stdout_port();
+Cell *stderr_port();
+
+prim_pairs port_prims();
+
+#endif
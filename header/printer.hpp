@@ -0,0 +1,52 @@
+
+#ifndef PRINTER_HEADER
+#define PRINTER_HEADER
+
+#include <unordered_map>
+#include "data.hpp"
+
+// Writes cells into a reusable buffer instead of piecemeal into a
+// stream. Lists are walked with an explicit stack so deep or long
+// structure does not recurse on the C++ stack.
+//
+// With `circle` set, shared and circular structure is detected first
+// and printed with `#n=` / `#n#` labels, like `*print-circle*`.
+// With `readable` set strings are quoted and escaped, as `write` does,
+// otherwise their chars are written as they are, as `display` does.
+struct Printer {
+public:
+    bool circle;
+    bool readable;
+
+    Printer(bool circle=false, bool readable=false) :
+        circle(circle), readable(readable) {}
+
+    Printer& print(Cell *exp);
+    Printer& write(const char *str) { buf.append(str); return *this; }
+    Printer& write(const char *str, size_t len) {
+        buf.append(str, len);
+        return *this;
+    }
+
+    const string& str() const { return buf; }
+    size_t size() const { return buf.size(); }
+    void clear() { buf.clear(); }
+
+    // write out the buffered text and reset the buffer
+    void flush(ostream &out);
+    void flush(FILE *out);
+
+private:
+    string buf;
+    vector<Cell*> stack;
+    // pair -> 0 (seen once), -1 (shared, not yet printed), n (label)
+    unordered_map<Cell*, long> labels;
+    long next_label;
+
+    void scan(Cell *exp);
+    bool print_label(Cell *exp);
+    void print_atom(Cell *exp);
+    void print_record(Cell *exp);
+};
+
+#endif
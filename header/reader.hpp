@@ -4,5 +4,15 @@
 
 #include "data.hpp"
 
+struct Port;
+
+// the next s-expression from input, the eof object at end of input
+Cell *lisp_read(Port *input);
+Cell *read_from_string(const char *string);
+// The length of the first complete s-expression in buf, with the space
+// and comments before it; 0 when buf holds only part of one. An atom
+// running to the end of buf is not complete, more of it may follow.
+size_t datum_end(const char *buf, size_t len);
+
 #endif
 
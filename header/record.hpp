@@ -0,0 +1,58 @@
+
+#ifndef RECORD_HEADER
+#define RECORD_HEADER
+
+#include "data.hpp"
+#include "env.hpp"
+
+// Fixed layout records, declared with
+//
+//   (defstruct point x y)
+//
+// which defines make-point, point?, point-x, point-y, set-point-x! and
+// set-point-y!. Slot offsets are fixed when the type is defined, an
+// instance is one TypeRecord cell pointing at a header and its slots in a
+// single block, so a field access is an index instead of an assoc.
+
+// Payload of a TypeRecordType cell.
+struct RecordType {
+    Cell *name;                 // symbol
+    vector<Cell*> fields;       // field symbols, in slot order
+};
+
+// Payload of a TypeRecord cell, followed by type->fields.size() slots.
+struct Record {
+    Cell *type;                 // its TypeRecordType cell
+
+    Cell **slots() { return (Cell**)(this + 1); }
+};
+
+enum RecordOp { RecordMake, RecordPred, RecordGet, RecordSet };
+
+// Payload of a TypeRecordProc cell, the procedures defstruct generates.
+// apply dispatches on op, slot is the field index for get/set.
+struct RecordProc {
+    RecordOp op;
+    Cell *type;
+    size_t slot;
+    Cell *name;                 // symbol it was defined as
+};
+
+#define is_record_type(x) (cell_type(x) == TypeRecordType)
+#define is_record(x) (cell_type(x) == TypeRecord)
+#define is_record_proc(x) (cell_type(x) == TypeRecordProc)
+#define as_record_type(x) ((RecordType*)(x)->val)
+#define as_record(x) ((Record*)(x)->val)
+#define as_record_proc(x) ((RecordProc*)(x)->val)
+
+#define record_type_of(x) as_record_type(as_record(x)->type)
+#define record_size(x) (record_type_of(x)->fields.size())
+
+// (defstruct name field ...), returns the name
+Cell *eval_defstruct(Cell *exp, Environment *env);
+Cell *apply_record_proc(Cell *proc, Cell *args);
+
+void free_record(Record *rec);
+void mark_record(Cell *rec);
+
+#endif
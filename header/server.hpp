@@ -0,0 +1,35 @@
+
+#ifndef SERVER_HEADER
+#define SERVER_HEADER
+
+#include "data.hpp"
+
+// An eval server on a Unix domain socket: lisp.out --server path [file ...]
+//
+// The files are loaded into the VM of the main thread, which is then
+// frozen (see VM::freeze); each connection evaluates in a VM cloned from
+// it, so clients start warm and cannot see each other. One thread
+// serves every connection with epoll: requests are s-expressions, read
+// as they arrive and evaluated in order, any number of them per read,
+// and each result goes back as soon as it is ready, printed readably on
+// a line of its own. Once a client shuts down its side, the connection
+// is closed after the last result has been written.
+//
+// Requests are evaluated one at a time, a slow one holds up the others
+// for as long as its limits let it run (see limits.hpp); one going past
+// them gets an error back, like a SIGINT or SIGTERM arriving meanwhile.
+// What they write to the output port goes to the server's stdout.
+
+// requests longer than this close their connection
+#define SERVER_MAX_REQUEST (1024 * 1024)
+// procedure calls and cells each request may use
+#define SERVER_REQUEST_FUEL (100 * 1000)
+#define SERVER_REQUEST_CELLS (16 * 1024 * 1024)
+
+// evaluates every expression in the file, false when it cannot be read
+bool load_file(const char *path);
+
+// Serves on path until SIGINT or SIGTERM, then returns the exit status.
+int run_server(const char *path);
+
+#endif
@@ -0,0 +1,30 @@
+
+#ifndef SIMD_HEADER
+#define SIMD_HEADER
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Kernels over contiguous double / int64 arrays. On x86 the double
+// kernels use AVX when the CPU has it and SSE2 otherwise, picked once at
+// startup; other targets get the plain loops.
+
+struct SimdKernels {
+    void (*f64_add)(double *out, const double *a, const double *b, size_t n);
+    void (*f64_sub)(double *out, const double *a, const double *b, size_t n);
+    void (*f64_mul)(double *out, const double *a, const double *b, size_t n);
+    void (*f64_scale)(double *out, const double *a, double k, size_t n);
+    double (*f64_dot)(const double *a, const double *b, size_t n);
+    double (*f64_sum)(const double *a, size_t n);
+    double (*f64_min)(const double *a, size_t n);
+    double (*f64_max)(const double *a, size_t n);
+
+    // int64 lanes wrap around on overflow, like C
+    void (*s64_add)(int64_t *out, const int64_t *a, const int64_t *b, size_t n);
+    void (*s64_sub)(int64_t *out, const int64_t *a, const int64_t *b, size_t n);
+    const char *name;
+};
+
+extern const SimdKernels &simd;
+
+#endif
@@ -0,0 +1,44 @@
+
+#ifndef STREAM_HEADER
+#define STREAM_HEADER
+
+#include "data.hpp"
+#include "env.hpp"
+
+// Memoized promises and SICP style streams on top of them.
+//
+//   (delay exp)          a promise to evaluate exp in the current env
+//   (cons-stream a b)    (cons a (delay b))
+//
+// A stream is nil or a pair whose cdr is a promise of the rest. Once a
+// promise is forced it drops its expression and environment and keeps
+// only the value, so a stream prefix nothing else points at any more is
+// garbage, however long the stream runs.
+
+// Payload of a TypePromise cell.
+struct Promise {
+    bool forced;
+    Cell *value;            // once forced
+    // until forced: the expression and its environment, or, for promises
+    // made by the stream primitives, native applied to exp
+    Cell *exp;
+    Environment *env;
+    PrimLispFn native;
+
+    void mark();
+};
+
+#define is_promise(x) (cell_type(x) == TypePromise)
+#define as_promise(x) ((Promise*)(x)->val)
+
+Cell *make_promise(Cell *exp, Environment *env);
+// value of a promise, anything else is returned as is; an error is not
+// memoized, forcing again retries
+Cell *force(Cell *promise);
+
+Cell *eval_delay(Cell *exp, Environment *env);
+Cell *eval_cons_stream(Cell *exp, Environment *env);
+
+prim_pairs stream_prims();
+
+#endif
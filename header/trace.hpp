@@ -0,0 +1,52 @@
+
+#ifndef TRACE_HEADER
+#define TRACE_HEADER
+
+#include <stdint.h>
+#include <atomic>
+#include "data.hpp"
+#include "env.hpp"
+
+// In-memory ring buffer of binary eval/apply/alloc events. Recording is
+// switched on at runtime (trace-start, or LISP_TRACE in the environment)
+// and costs one predictable branch while off. Building with
+// -DLISP_NO_TRACE removes it entirely.
+
+#define TRACE_RING_SIZE 4096 // power of 2
+
+enum TraceKind : uint8_t {
+    TraceEval,
+    TraceApply,
+    TraceAlloc,
+    TraceGC             // arg is the heap size before collecting
+};
+
+struct TraceEvent {
+    uint64_t ticks;
+    uint8_t kind;
+    uint8_t type;       // LispType of obj when recorded
+    void *obj;
+    void *arg;          // env for eval, args for apply
+};
+
+extern std::atomic<bool> trace_enabled;
+
+void trace_record(TraceKind kind, Cell *obj, void *arg);
+void trace_start();
+void trace_stop();
+void trace_dump(FILE *out);
+void trace_dump_binary(FILE *out);
+
+prim_pairs trace_prims();
+
+#ifdef LISP_NO_TRACE
+#define trace_event(kind, obj, arg) ((void)0)
+#else
+#define trace_event(kind, obj, arg) ({                                  \
+            if (__builtin_expect(                                       \
+                    trace_enabled.load(std::memory_order_relaxed), 0))  \
+                trace_record(kind, obj, (void*)(arg));                  \
+        })
+#endif
+
+#endif
@@ -0,0 +1,48 @@
+
+#ifndef VALUES_HEADER
+#define VALUES_HEADER
+
+#include "data.hpp"
+#include "env.hpp"
+
+// Multiple return values.
+//
+//   (values a b ...)                  several results
+//   (call-with-values producer consumer)
+//   (receive (var ...) exp body ...)  binds the values of exp
+//
+// (values x) is just x. Any other count leaves the results in the
+// calling thread's values buffer and returns the shared values marker,
+// so handing back several results allocates nothing on the heap. The
+// buffer is only valid until the next values call, so only
+// call-with-values and receive take the marker as it is. Every place
+// that keeps a single value (arguments, definitions, callback results)
+// collapses it with first_value.
+
+// results of the last multi-valued return on this thread
+extern thread_local vector<Cell*> values_buffer;
+
+Cell *values_marker();
+// the marker is the only cell of its type
+#define is_values(x) (cell_type(x) == TypeValues)
+
+// x itself, or the first of its values when it is the values marker
+// (nil for none)
+inline Cell *first_value(Cell *x) {
+    if (!is_values(x))
+        return x;
+    return values_buffer.empty() ? nil() : values_buffer[0];
+}
+
+// returns a and b as two values
+Cell *values2(Cell *a, Cell *b);
+
+// Applies fn to the values of result: all of them when it is the
+// values marker, else result alone.
+Cell *apply_values(Cell *fn, Cell *result);
+
+Cell *eval_receive(Cell *exp, Environment *env);
+
+prim_pairs values_prims();
+
+#endif
@@ -0,0 +1,32 @@
+
+#ifndef VECTOR_HEADER
+#define VECTOR_HEADER
+
+#include <stdint.h>
+#include "data.hpp"
+#include "env.hpp"
+
+// Unboxed homogeneous vectors in the style of SRFI 4: f64vector holds
+// doubles, s64vector holds int64. The payload is a single 32 byte aligned
+// block, this header followed by the elements, so the SIMD kernels in
+// simd.hpp can stream over it.
+struct alignas(32) NumVector {
+    size_t len;
+
+    double *f64() { return (double*)(this + 1); }
+    int64_t *s64() { return (int64_t*)(this + 1); }
+};
+
+#define is_f64vector(x) (cell_type(x) == TypeF64Vector)
+#define is_s64vector(x) (cell_type(x) == TypeS64Vector)
+#define is_numvector(x) (is_f64vector(x) || is_s64vector(x))
+#define as_numvector(x) ((NumVector*)(x)->val)
+
+// element storage is left uninitialized
+Cell *make_numvector(LispType type, size_t len);
+void free_numvector(NumVector *vec);
+bool numvector_equal(Cell *x, Cell *y);
+
+prim_pairs vector_prims();
+
+#endif
@@ -0,0 +1,149 @@
+
+#include "arena.hpp"
+
+#if LISP_COMPRESSED_REFS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <mutex>
+#include <vector>
+
+char *arena_base = NULL;
+size_t arena_bytes = 0;
+
+// guards the fields below, and the reservation
+static std::mutex arena_lock;
+// handed out so far, slot 0 standing for NULL
+static size_t arena_top = ARENA_CELL_SIZE;
+static size_t arena_committed = 0;
+
+// lists of ARENA_BATCH freed cells, left by the threads that freed them
+static std::vector<void*> &pooled() {
+    static std::vector<void*> *lists = new std::vector<void*>();
+    return *lists;
+}
+
+// reserves as much of ARENA_CELLS as the system lets us
+static void reserve() {
+    for (size_t bytes = ARENA_CELLS * ARENA_CELL_SIZE; bytes >= ARENA_COMMIT;
+         bytes /= 2) {
+        void *p = mmap(NULL, bytes, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p != MAP_FAILED) {
+            arena_base = (char*)p;
+            arena_bytes = bytes;
+            return;
+        }
+    }
+    perror("cannot reserve the cell arena");
+    abort();
+}
+
+// n fresh cells, committing more of the arena when needed
+static char *claim(size_t n) {
+    std::lock_guard<std::mutex> guard(arena_lock);
+    if (arena_base == NULL)
+        reserve();
+    size_t bytes = n * ARENA_CELL_SIZE;
+    if (arena_top + bytes > arena_bytes) {
+        fprintf(stderr, "the cell arena is full\n");
+        abort();
+    }
+    while (arena_top + bytes > arena_committed) {
+        size_t grow = std::min((size_t)ARENA_COMMIT,
+                               arena_bytes - arena_committed);
+        if (mprotect(arena_base + arena_committed, grow,
+                     PROT_READ | PROT_WRITE) != 0) {
+            perror("cannot commit the cell arena");
+            abort();
+        }
+        arena_committed += grow;
+    }
+    char *cells = arena_base + arena_top;
+    arena_top += bytes;
+    return cells;
+}
+
+// Freed cells are chained through their first word.
+struct ArenaCache {
+    void *free = NULL;
+    size_t nfree = 0;
+    // the rest of the fresh cells claimed last
+    char *fresh = NULL;
+    char *fresh_end = NULL;
+
+    ~ArenaCache() {
+        if (free) {
+            std::lock_guard<std::mutex> guard(arena_lock);
+            pooled().push_back(free);
+        }
+    }
+};
+
+static thread_local ArenaCache cache;
+
+void *arena_alloc() {
+    ArenaCache &c = cache;
+    if (c.free == NULL && c.fresh == c.fresh_end) {
+        std::lock_guard<std::mutex> guard(arena_lock);
+        if (!pooled().empty()) {
+            c.free = pooled().back();
+            c.nfree = ARENA_BATCH;
+            pooled().pop_back();
+        }
+    }
+    if (c.free) {
+        void *cell = c.free;
+        c.free = *(void**)cell;
+        if (c.nfree)
+            c.nfree--;
+        return cell;
+    }
+    if (c.fresh == c.fresh_end) {
+        c.fresh = claim(ARENA_BATCH);
+        c.fresh_end = c.fresh + ARENA_BATCH * ARENA_CELL_SIZE;
+    }
+    void *cell = c.fresh;
+    c.fresh += ARENA_CELL_SIZE;
+    return cell;
+}
+
+// Runs come from fresh cells only; once freed, their cells are reused
+// one at a time.
+void *arena_alloc_run(size_t n) {
+    ArenaCache &c = cache;
+    size_t bytes = n * ARENA_CELL_SIZE;
+    if ((size_t)(c.fresh_end - c.fresh) < bytes) {
+        if (n > ARENA_BATCH)
+            return claim(n);
+        // what is left of the chunk goes on the free list
+        for (; c.fresh < c.fresh_end; c.fresh += ARENA_CELL_SIZE)
+            arena_free(c.fresh);
+        c.fresh = claim(ARENA_BATCH);
+        c.fresh_end = c.fresh + ARENA_BATCH * ARENA_CELL_SIZE;
+    }
+    void *cells = c.fresh;
+    c.fresh += bytes;
+    return cells;
+}
+
+void arena_free(void *cell) {
+    ArenaCache &c = cache;
+    *(void**)cell = c.free;
+    c.free = cell;
+    if (++c.nfree < ARENA_BATCH)
+        return;
+    std::lock_guard<std::mutex> guard(arena_lock);
+    pooled().push_back(c.free);
+    c.free = NULL;
+    c.nfree = 0;
+}
+
+void arena_outside(const void *cell) {
+    fprintf(stderr, "cell %p is outside the arena, it cannot be a cdr\n",
+            cell);
+    abort();
+}
+
+#endif
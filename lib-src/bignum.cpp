@@ -0,0 +1,293 @@
+
+#include <limits.h>
+#include <string.h>
+#include "bignum.hpp"
+
+typedef vector<uint32_t> Limbs;
+
+static void trim(Limbs &a) {
+    while (!a.empty() && a.back() == 0)
+        a.pop_back();
+}
+
+static int mag_cmp(const Limbs &a, const Limbs &b) {
+    if (a.size() != b.size())
+        return a.size() < b.size() ? -1 : 1;
+    for (size_t i = a.size(); i-- > 0;) {
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static Limbs mag_add(const Limbs &a, const Limbs &b) {
+    const Limbs &l = a.size() >= b.size() ? a : b;
+    const Limbs &s = a.size() >= b.size() ? b : a;
+    Limbs out(l.size() + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < l.size(); i++) {
+        uint64_t t = (uint64_t)l[i] + (i < s.size() ? s[i] : 0) + carry;
+        out[i] = (uint32_t)t;
+        carry = t >> 32;
+    }
+    out[l.size()] = (uint32_t)carry;
+    trim(out);
+    return out;
+}
+
+// a - b, requires |a| >= |b|
+static Limbs mag_sub(const Limbs &a, const Limbs &b) {
+    Limbs out(a.size());
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        int64_t t = (int64_t)a[i] - (i < b.size() ? b[i] : 0) - borrow;
+        borrow = t < 0;
+        out[i] = (uint32_t)(t + (borrow << 32));
+    }
+    trim(out);
+    return out;
+}
+
+static Limbs mag_mul(const Limbs &a, const Limbs &b) {
+    if (a.empty() || b.empty())
+        return Limbs();
+    Limbs out(a.size() + b.size());
+    for (size_t i = 0; i < a.size(); i++) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < b.size(); j++) {
+            uint64_t t = (uint64_t)a[i] * b[j] + out[i + j] + carry;
+            out[i + j] = (uint32_t)t;
+            carry = t >> 32;
+        }
+        out[i + b.size()] = (uint32_t)carry;
+    }
+    trim(out);
+    return out;
+}
+
+// a = a * m + add
+static void mag_mul_add_small(Limbs &a, uint32_t m, uint32_t add) {
+    uint64_t carry = add;
+    for (size_t i = 0; i < a.size(); i++) {
+        uint64_t t = (uint64_t)a[i] * m + carry;
+        a[i] = (uint32_t)t;
+        carry = t >> 32;
+    }
+    if (carry)
+        a.push_back((uint32_t)carry);
+}
+
+// a = a / d, returns the remainder
+static uint32_t mag_div_small(Limbs &a, uint32_t d) {
+    uint64_t rem = 0;
+    for (size_t i = a.size(); i-- > 0;) {
+        uint64_t cur = (rem << 32) | a[i];
+        a[i] = (uint32_t)(cur / d);
+        rem = cur % d;
+    }
+    trim(a);
+    return (uint32_t)rem;
+}
+
+// Knuth's algorithm D, as laid out in Hacker's Delight (divmnu).
+static void mag_divmod(const Limbs &u, const Limbs &v, Limbs &q, Limbs &r) {
+    if (mag_cmp(u, v) < 0) {
+        q.clear();
+        r = u;
+        return;
+    }
+    if (v.size() == 1) {
+        q = u;
+        uint32_t rem = mag_div_small(q, v[0]);
+        r.clear();
+        if (rem)
+            r.push_back(rem);
+        return;
+    }
+
+    size_t n = v.size(), m = u.size() - n;
+    int s = __builtin_clz(v[n - 1]);
+    // normalize so the top limb of the divisor has its high bit set
+    Limbs vn(n), un(u.size() + 1);
+    for (size_t i = n - 1; i > 0; i--)
+        vn[i] = (v[i] << s) | (s ? (uint32_t)((uint64_t)v[i - 1] >> (32 - s)) : 0);
+    vn[0] = v[0] << s;
+    un[u.size()] = s ? (uint32_t)((uint64_t)u[u.size() - 1] >> (32 - s)) : 0;
+    for (size_t i = u.size() - 1; i > 0; i--)
+        un[i] = (u[i] << s) | (s ? (uint32_t)((uint64_t)u[i - 1] >> (32 - s)) : 0);
+    un[0] = u[0] << s;
+
+    const uint64_t b = 1ULL << 32;
+    q.assign(m + 1, 0);
+    for (size_t j = m + 1; j-- > 0;) {
+        uint64_t num = ((uint64_t)un[j + n] << 32) | un[j + n - 1];
+        uint64_t qhat = num / vn[n - 1];
+        uint64_t rhat = num % vn[n - 1];
+        while (qhat >= b
+               || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+            qhat--;
+            rhat += vn[n - 1];
+            if (rhat >= b)
+                break;
+        }
+
+        // multiply and subtract
+        int64_t k = 0, t;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t p = qhat * vn[i];
+            t = (int64_t)un[i + j] - k - (int64_t)(p & 0xFFFFFFFFULL);
+            un[i + j] = (uint32_t)t;
+            k = (int64_t)(p >> 32) - (t >> 32);
+        }
+        t = (int64_t)un[j + n] - k;
+        un[j + n] = (uint32_t)t;
+
+        q[j] = (uint32_t)qhat;
+        if (t < 0) {
+            // subtracted too much, add back
+            q[j]--;
+            uint64_t c = 0;
+            for (size_t i = 0; i < n; i++) {
+                uint64_t t2 = (uint64_t)un[i + j] + vn[i] + c;
+                un[i + j] = (uint32_t)t2;
+                c = t2 >> 32;
+            }
+            un[j + n] += (uint32_t)c;
+        }
+    }
+
+    r.assign(n, 0);
+    for (size_t i = 0; i < n; i++)
+        r[i] = (un[i] >> s) | (s ? (uint32_t)((uint64_t)un[i + 1] << (32 - s)) : 0);
+    trim(q);
+    trim(r);
+}
+
+//
+
+BigInt::BigInt(long x) : neg(x < 0) {
+    unsigned long u = neg ? 0UL - (unsigned long)x : (unsigned long)x;
+    while (u) {
+        mag.push_back((uint32_t)u);
+        u >>= 32;
+    }
+}
+
+BigInt BigInt::from_string(const char *digits) {
+    BigInt out;
+    bool neg = false;
+    if (*digits == '-' || *digits == '+')
+        neg = *digits++ == '-';
+    for (; *digits; digits++)
+        mag_mul_add_small(out.mag, 10, *digits - '0');
+    trim(out.mag);
+    out.neg = neg && !out.is_zero();
+    return out;
+}
+
+bool BigInt::fits_long() const {
+    if (mag.size() > 2)
+        return false;
+    uint64_t u = 0;
+    for (size_t i = mag.size(); i-- > 0;)
+        u = (u << 32) | mag[i];
+    return neg ? u <= (uint64_t)LONG_MAX + 1 : u <= (uint64_t)LONG_MAX;
+}
+
+long BigInt::to_long() const {
+    uint64_t u = 0;
+    for (size_t i = mag.size(); i-- > 0;)
+        u = (u << 32) | mag[i];
+    return neg ? (long)(0 - u) : (long)u;
+}
+
+double BigInt::to_double() const {
+    double d = 0;
+    for (size_t i = mag.size(); i-- > 0;)
+        d = d * 4294967296.0 + mag[i];
+    return neg ? -d : d;
+}
+
+string BigInt::to_string() const {
+    if (is_zero())
+        return "0";
+    // peel off base 10^9 chunks, least significant first
+    Limbs tmp = mag;
+    vector<uint32_t> chunks;
+    while (!tmp.empty())
+        chunks.push_back(mag_div_small(tmp, 1000000000));
+
+    string out = neg ? "-" : "";
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u", chunks.back());
+    out += buf;
+    for (size_t i = chunks.size() - 1; i-- > 0;) {
+        snprintf(buf, sizeof(buf), "%09u", chunks[i]);
+        out += buf;
+    }
+    return out;
+}
+
+size_t BigInt::hash() const {
+    size_t h = neg ? 0x9e3779b97f4a7c15ULL : 0;
+    for (uint32_t limb : mag)
+        h = (h ^ limb) * 0x100000001b3ULL;
+    return h;
+}
+
+BigInt BigInt::operator-() const {
+    BigInt out = *this;
+    out.neg = !neg && !is_zero();
+    return out;
+}
+
+BigInt operator+(const BigInt &a, const BigInt &b) {
+    BigInt out;
+    if (a.neg == b.neg) {
+        out.mag = mag_add(a.mag, b.mag);
+        out.neg = a.neg;
+    } else if (mag_cmp(a.mag, b.mag) >= 0) {
+        out.mag = mag_sub(a.mag, b.mag);
+        out.neg = a.neg;
+    } else {
+        out.mag = mag_sub(b.mag, a.mag);
+        out.neg = b.neg;
+    }
+    out.neg = out.neg && !out.is_zero();
+    return out;
+}
+
+BigInt operator-(const BigInt &a, const BigInt &b) {
+    return a + (-b);
+}
+
+BigInt operator*(const BigInt &a, const BigInt &b) {
+    BigInt out;
+    out.mag = mag_mul(a.mag, b.mag);
+    out.neg = (a.neg != b.neg) && !out.is_zero();
+    return out;
+}
+
+void BigInt::divmod(const BigInt &a, const BigInt &b, BigInt &q, BigInt &r) {
+    mag_divmod(a.mag, b.mag, q.mag, r.mag);
+    q.neg = (a.neg != b.neg) && !q.is_zero();
+    r.neg = a.neg && !r.is_zero();
+}
+
+BigInt BigInt::gcd(BigInt a, BigInt b) {
+    a.neg = b.neg = false;
+    while (!b.is_zero()) {
+        BigInt q, r;
+        divmod(a, b, q, r);
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+int BigInt::compare(const BigInt &a, const BigInt &b) {
+    if (a.neg != b.neg)
+        return a.neg ? -1 : 1;
+    int c = mag_cmp(a.mag, b.mag);
+    return a.neg ? -c : c;
+}
@@ -1,131 +1,844 @@
 
 #include <stdarg.h>
+#include <setjmp.h>
+#include <malloc.h>
+#include <new>
+#include <pthread.h>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include "data.hpp"
 #include "env.hpp"
 #include "reader.hpp"
+#include "trace.hpp"
+#include "error.hpp"
+#include "number.hpp"
+#include "vector.hpp"
+#include "hashtable.hpp"
+#include "lstring.hpp"
+#include "record.hpp"
+#include "stream.hpp"
+#include "values.hpp"
+#include "port.hpp"
+#include "future.hpp"
+#include "green.hpp"
+#include "pool.hpp"
+#include "limits.hpp"
+#include "heap.hpp"
+#include "lisp.hpp"
 
 /* #define TODO(str) (printf("at %s: %s", __func__, str);) */
 #define TODO(str) printf(str);
 
 
-static Cell sym_nil = Cell(TypeSymbol, NULL);
-inline Cell *nil(void) { return &sym_nil; }
+static Cell *sym_nil = permanent(Cell(TypeSymbol, NULL));
+Cell *nil(void) { return sym_nil; }
 
-static VM *global_vm = new VM();
-inline VM *getVM(void) { return global_vm; }
+#if LISP_COMPRESSED_REFS
+// names of the primitives by function, shared by all VMs
+static std::mutex prim_names_lock;
+static unordered_map<void*, const char*> &prim_names() {
+    static unordered_map<void*, const char*> *names =
+        new unordered_map<void*, const char*>();
+    return *names;
+}
+
+void set_prim_name(Cell *prim, const char *name) {
+    lock_guard<mutex> guard(prim_names_lock);
+    prim_names()[prim->val] = name;
+}
+
+const char *prim_name_of(void *fn) {
+    lock_guard<mutex> guard(prim_names_lock);
+    return prim_names()[fn];
+}
+#endif
+
+static thread_local VM *current_vm = NULL;
+
+// the VM getVM made for this thread, freed with the thread
+static thread_local struct OwnVM {
+    VM *vm = NULL;
+    ~OwnVM() {
+        if (current_vm == vm)
+            current_vm = NULL;
+        delete vm;
+    }
+} own_vm;
+
+VM *getVM(void) {
+    if (current_vm == NULL) {
+        own_vm.vm = new VM();
+        current_vm = own_vm.vm;
+    }
+    return current_vm;
+}
 
-inline bool null(Cell *x) {
-    return x == nil() || x == intern("nil");
+VM *setVM(VM *vm) {
+    VM *prev = current_vm;
+    current_vm = vm;
+    return prev;
 }
 
+bool null(Cell *x) {
+    return x == nil() || x == getVM()->nil_symbol;
+}
+
+Cell *true_symbol(void) {
+    return getVM()->t_symbol;
+}
+
+thread_local List *alloc_sink = NULL;
+
 bool is_number(Cell *x) {
     return x->type == TypeInt
         || x->type == TypeFloat
         || x->type == TypeRatio
-        || x->type == TypeFixNum;
+        || x->type == TypeFixNum
+        || x->type == TypeBigNum;
 }
 
 VM::VM() {
     // Creates a new VM with an empty stack and an empty (but allocated) heap.
     heap = List();
     symbols = List();
+    in_flight = 0;
+    tasks_running = 0;
+    stopping = false;
+    collecting = false;
+    gc_wanted = false;
+    root_env = NULL;
+    base = NULL;
+    frozen = false;
+    green = NULL;
+    fuel = NO_LIMIT;
+    cells_allocated = 0;
+    cell_limit = NO_LIMIT;
+    cancelled = false;
+    heap_limits = default_heap_limits();
+    gc_threshold = next_gc_threshold(heap_limits, 0);
+    task_room = gc_threshold;
+    run_cells = 0;
+    nil_symbol = getSymbol("nil");
+    t_symbol = getSymbol("t");
+    // the primitives are made in the new VM, whichever one the thread
+    // is using
+    VMScope scope(this);
     root_env = init_environment(this);
+    for (int i = 0; i < FormCount; i++)
+        forms[i] = getSymbol(special_forms[i]);
+    for (auto &entry : symbol_table)
+        symbols.push_back(entry.second);
+}
+
+VM::VM(VM *base) : base(base), frozen(false), green(NULL) {
+    if (!base->frozen) {
+        fprintf(stderr, "cloning a VM that is not frozen\n");
+        abort();
+    }
+    in_flight = 0;
+    tasks_running = 0;
+    stopping = false;
+    collecting = false;
+    gc_wanted = false;
+    fuel = NO_LIMIT;
+    cells_allocated = 0;
+    cell_limit = NO_LIMIT;
+    cancelled = false;
+    heap_limits = base->heap_limits;
+    gc_threshold = next_gc_threshold(heap_limits, 0);
+    task_room = gc_threshold;
+    run_cells = 0;
+    nil_symbol = base->nil_symbol;
+    t_symbol = base->t_symbol;
+    copy(base->forms, base->forms + FormCount, forms);
+    // the globals of base are the tail of this frame, see env_lookup_var
+    root_env = new Environment();
+    root_env->set_frame(base->root_env->frame());
+}
+
+void VM::freeze() {
+    // futures still running would add cells after the fact
+    help_until([this] { return in_flight.load() == 0; });
+    gc();
+    for (Cell *cell : heap) {
+        // lookups must not move entries around later
+        if (is_hashtable(cell))
+            as_hashtable(cell)->finish_rehash();
+        for (size_t i = 0; i <= cell->run; i++)
+            cell[i].in_use = true;
+    }
+    root_env->in_use = true;
+    frozen = true;
+}
+
+VM::~VM() {
+    // tasks of the VM still queued or running use it until they finish,
+    // which the cancel hurries along
+    cancel_eval(this);
+    help_until([this] { return in_flight.load() == 0; });
+    adopt_pending();
+    for (Cell *cell : heap)
+        cell->free_cell();
+    delete root_env;
+    delete green;
 }
 
 //
 
+static void free_run(Cell *run) {
+#if LISP_COMPRESSED_REFS
+    for (size_t i = 0; i <= run->run; i++)
+        arena_free(&run[i]);
+#else
+    free(run);
+#endif
+}
+
 void Cell::free_cell() {
     switch(this->type) {
     case TypeString: {
+        free_lstring(as_lstring(this));
+        delete this;
+    } break;
+    case TypeStringBuilder: {
+        delete as_string_builder(this);
+        delete this;
+    } break;
+    case TypeRecordType: {
+        delete as_record_type(this);
+        delete this;
+    } break;
+    case TypeRecord: {
+        free_record(as_record(this));
+        delete this;
+    } break;
+    case TypeRecordProc: {
+        delete as_record_proc(this);
         delete this;
     } break;
     case TypePair:
-        if (!null(this) && !this->in_use) {
-            this->car()->free_cell();
-            this->cdr()->free_cell();
+        // the car and cdr are swept on their own
+        if (this->run)
+            free_run(this);
+        else
             delete this;
-        }
         break;
-    case TypeProcedure: {
-        delete this->as_procedure();
+    case TypeEnvironment:
+        delete (Environment*)this;
+        break;
+    case TypeError: {
+        delete as_error(this);
+        delete this;
+    } break;
+    case TypeBigNum: {
+        delete as_bignum(this);
+        delete this;
+    } break;
+    case TypeRatio: {
+        delete as_ratio(this);
+        delete this;
+    } break;
+    case TypeF64Vector:
+    case TypeS64Vector: {
+        free_numvector(as_numvector(this));
+        delete this;
+    } break;
+    case TypeHashTable: {
+        delete as_hashtable(this);
+        delete this;
+    } break;
+    case TypePromise: {
+        delete as_promise(this);
+        delete this;
+    } break;
+    case TypePort: {
+        delete as_port(this);
+        delete this;
+    } break;
+    case TypeFuture: {
+        delete as_future(this);
+        delete this;
+    } break;
+    case TypeGreenThread: {
+        delete as_green_thread(this);
+        delete this;
+    } break;
+    case TypeChannel: {
+        delete as_channel(this);
         delete this;
     } break;
     case TypeSymbol:
+        free(this->val);
+        delete this;
+        break;
     case TypeInt:
     case TypeFixNum:
     case TypeFloat:
-    case TypeRatio:
     default:
         delete this;
         break;
     }
 }
 
+// Marking is spread over the pool when the heap is large (see VM::gc).
+// Each marker keeps the cells it has marked but not yet scanned on its
+// own stack; `local` is private to the marker, `shared` is where it puts
+// part of that work for idle markers to steal.
+struct MarkStack {
+    vector<Cell*> local;
+    mutex lock;
+    vector<Cell*> shared;
+    atomic<size_t> shared_size{0};
+
+    // moves the newer half of local to shared, if that has run dry
+    void share() {
+        if (shared_size.load(memory_order_relaxed) > 0)
+            return;
+        lock_guard<mutex> g(lock);
+        size_t half = local.size() / 2;
+        shared.assign(local.end() - half, local.end());
+        local.resize(local.size() - half);
+        shared_size = shared.size();
+    }
+    // moves all of shared to thief's local
+    bool steal(vector<Cell*> &thief) {
+        if (shared_size.load(memory_order_relaxed) == 0)
+            return false;
+        lock_guard<mutex> g(lock);
+        thief.insert(thief.end(), shared.begin(), shared.end());
+        shared.clear();
+        shared_size = 0;
+        return !thief.empty();
+    }
+};
+
+struct MarkState {
+    vector<MarkStack> stacks;
+    // markers holding work; marking is over once it is 0 with every
+    // shared stack empty
+    atomic<size_t> busy{0};
+
+    MarkState(size_t n) : stacks(n) {}
+};
+
+// the stack of the marker running on this thread
+static thread_local MarkStack *marking = NULL;
+
+// a marker offers work once it has this many cells waiting
+#define MARK_SHARE_SIZE 64
+// heaps smaller than this are marked and swept on one thread
+#define PARALLEL_GC_MIN (64 * 1024)
+
 // Marks [object] as being reachable and still (potentially) in use.
+// Its fields are marked later from the mark stack, so deep or long
+// structure does not recurse on the C++ stack. The mark bit is set
+// atomically so that two markers reaching a cell scan it once.
 void Cell::mark() {
-    // If already marked, we're done. Check this first to avoid recursing
-    // on cycles in the object graph.
-    if (this->in_use) return;
-
-    // Any non-zero pointer indicates the object was reached. For no particular
-    // reason, we use the object's own address as the marked value.
-    this->in_use = true;
+    // If already marked, we're done. Check this first to avoid looping
+    // on cycles in the object graph. Permanent cells are never written.
+    if (__atomic_load_n(&this->in_use, __ATOMIC_RELAXED)
+        || __atomic_exchange_n(&this->in_use, true, __ATOMIC_RELAXED))
+        return;
+    marking->local.push_back(this);
+}
 
-    // Recurse into the object's fields.
+void Cell::mark_children() {
     if (is_pair(this)) {
-        this->car()->mark();
-        this->cdr()->mark();
+        if (this->val) this->car()->mark();
+        if (this->next) this->next->mark();
+    }
+    else if (is_procedure(this) || this->type == TypeEnvironment) {
+        // (param . body) and the environment, or the frame and the parent
+        this->as_cell()->mark();
+        if (this->next) this->next->mark();
+    }
+    else if (is_error(this)) {
+        as_error(this)->mark();
+    }
+    else if (is_hashtable(this)) {
+        as_hashtable(this)->mark();
+    }
+    else if (is_string(this) && as_lstring(this)->is_view()) {
+        as_lstring(this)->base->mark();
+    }
+    else if (is_record(this)) {
+        mark_record(this);
+    }
+    else if (is_record_type(this)) {
+        as_record_type(this)->name->mark();
+        for (Cell *field : as_record_type(this)->fields)
+            field->mark();
+    }
+    else if (is_record_proc(this)) {
+        as_record_proc(this)->type->mark();
+        as_record_proc(this)->name->mark();
+    }
+    else if (is_promise(this)) {
+        as_promise(this)->mark();
+    }
+    else if (is_future(this)) {
+        as_future(this)->mark();
+    }
+    else if (is_green_thread(this)) {
+        as_green_thread(this)->mark();
+    }
+    else if (is_channel(this)) {
+        as_channel(this)->mark();
+    }
+}
+
+// Top of the calling thread's stack, looked up once per thread.
+static void **stack_top() {
+    static thread_local void **top = NULL;
+    if (top == NULL) {
+        pthread_attr_t attr;
+        void *addr;
+        size_t size;
+        pthread_getattr_np(pthread_self(), &attr);
+        pthread_attr_getstack(&attr, &addr, &size);
+        pthread_attr_destroy(&attr);
+        top = (void**)((char*)addr + size);
+    }
+    return top;
+}
+
+// heap must be sorted
+Cell *VM::findCell(void *p) {
+    auto it = upper_bound(heap.begin(), heap.end(), (Cell*)p);
+    if (it == heap.begin())
+        return NULL;
+    Cell *cell = *--it;
+    size_t off = (char*)p - (char*)cell;
+    if (off % sizeof(Cell) == 0 && off / sizeof(Cell) <= cell->run)
+        return (Cell*)p;
+    return NULL;
+}
+
+// heap must be sorted; the words are read whole frames at a time, which
+// AddressSanitizer takes for overflows of the locals in them
+__attribute__((no_sanitize_address))
+void VM::mark_range(void **from, void **to) {
+    for (void **p = from; p < to; p++) {
+        if (Cell *cell = findCell(*p))
+            cell->mark();
+#if LISP_COMPRESSED_REFS
+        // either half of the word may be a cdr on its way to becoming a
+        // pointer, e.g. in the dummy head of a list being built
+        uint32_t halves[2];
+        memcpy(halves, p, sizeof halves);
+        for (uint32_t index : halves) {
+            CellRef ref;
+            ref.index = index;
+            Cell *cell = ref;
+            if (cell && !heap.empty() && cell >= heap.front()
+                && (cell = findCell(cell)))
+                cell->mark();
+        }
+#endif
     }
-    else if (is_procedure(this)) {
-        Procedure *proc = this->as_procedure();
-        proc->param->mark();
-        proc->body->mark();
-        proc->env->mark();
+}
+
+// Conservative roots: every word on the stack that holds the address of
+// a heap cell or environment marks it. setjmp spills the callee saved
+// registers into this frame first, so values only held in registers are
+// seen too. On a green thread the stack in use is the thread's; the
+// thread's own stack and those of the other green threads are scanned
+// from where they were switched out.
+__attribute__((noinline)) void VM::mark_stack() {
+    jmp_buf regs;
+    setjmp(regs);
+    void **top = green_stack_top(this);
+    mark_range((void**)&regs, top ? top : stack_top());
+    green_mark_roots(this, stack_top());
+}
+
+void VM::adopt_pending() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    heap.insert(heap.end(), pending.begin(), pending.end());
+    cells_allocated += pending.size();
+    pending.clear();
+}
+
+// Steals from the other markers first, then its own shared stack.
+static bool steal_marks(MarkState &st, size_t id) {
+    size_t n = st.stacks.size();
+    for (size_t i = 1; i <= n; i++)
+        if (st.stacks[(id + i) % n].steal(st.stacks[id].local))
+            return true;
+    return false;
+}
+
+// Scans gray cells until no marker has any left.
+static void run_marker(MarkState &st, size_t id) {
+    MarkStack *own = &st.stacks[id];
+    MarkStack *outer = marking;
+    marking = own;
+    st.busy++;
+    for (;;) {
+        while (!own->local.empty()) {
+            Cell *cell = own->local.back();
+            own->local.pop_back();
+            cell->mark_children();
+            if (own->local.size() >= MARK_SHARE_SIZE)
+                own->share();
+        }
+        if (steal_marks(st, id))
+            continue;
+        // out of work: wait for some to be shared, or for the others to
+        // run out too
+        st.busy--;
+        bool found = false;
+        while (!found && st.busy.load() > 0) {
+            st.busy++;
+            found = steal_marks(st, id);
+            if (!found) {
+                st.busy--;
+                this_thread::yield();
+            }
+        }
+        if (!found)
+            break;
     }
+    marking = outer;
 }
 
+// Whether any pair of a run is marked. If so the run stays: the pairs
+// that are not marked are cleared, as what they point at may be freed,
+// and so are the marks of all but the first, which sweep clears.
+static bool settle_run(Cell *run) {
+    bool alive = false;
+    for (size_t i = 0; i <= run->run && !alive; i++)
+        alive = run[i].in_use;
+    if (!alive)
+        return false;
+    for (size_t i = 0; i <= run->run; i++) {
+        if (!run[i].in_use) {
+            run[i].val = nil();
+            run[i].next = nil();
+        } else if (i > 0) {
+            run[i].in_use = false;
+        }
+    }
+    return true;
+}
+
+static bool survives(Cell *cell) {
+    return cell->run ? settle_run(cell) : cell->in_use;
+}
+
+// Frees the unmarked objects of objs and compacts the survivors in
+// place, clearing their marks. Large vectors are cut into one region per
+// thread, swept side by side, then closed up.
+template<typename T, typename Free>
+static void sweep(vector<T*> &objs, bool parallel, Free free_obj) {
+    size_t regions = parallel ? pool_size() : 1;
+    vector<size_t> bounds(regions + 1), live(regions);
+    for (size_t i = 0; i <= regions; i++)
+        bounds[i] = objs.size() * i / regions;
+    auto sweep_region = [&](size_t r) {
+        size_t out = bounds[r];
+        for (size_t i = bounds[r]; i < bounds[r + 1]; i++) {
+            T *obj = objs[i];
+            if (survives(obj)) {
+                obj->in_use = false;
+                objs[out++] = obj;
+            } else {
+                free_obj(obj);
+            }
+        }
+        live[r] = out - bounds[r];
+    };
+    if (regions == 1)
+        sweep_region(0);
+    else
+        parallel_run(regions, sweep_region);
+
+    size_t n = live[0];
+    for (size_t r = 1; r < regions; r++) {
+        copy(objs.begin() + bounds[r], objs.begin() + bounds[r] + live[r],
+             objs.begin() + n);
+        n += live[r];
+    }
+    objs.resize(n);
+}
+
+// Stops the tasks of vm at their next safe point and takes what they
+// have allocated into the heap.
+static void stop_tasks(VM *vm) {
+    unique_lock<mutex> g(vm->task_lock);
+    vm->stopping = true;
+    vm->task_cv.wait(g, [vm] { return vm->tasks_running == 0; });
+    vm->collecting = true;
+    for (List *sink : vm->sinks) {
+        vm->heap.insert(vm->heap.end(), sink->begin(), sink->end());
+        vm->cells_allocated += sink->size();
+        sink->clear();
+    }
+}
+
+static void resume_tasks(VM *vm) {
+    vm->collecting = false;
+    {
+        lock_guard<mutex> g(vm->task_lock);
+        vm->stopping = false;
+    }
+    vm->task_cv.notify_all();
+}
+
+// The roots the tasks of vm hold: the stacks of those stopped, and the
+// futures not yet out of the queue. Their allocation buffers are in the
+// heap by now.
+static void mark_tasks(VM *vm) {
+    for (StoppedTask *t : vm->stopped) {
+        vm->mark_range(t->from, t->to);
+        if (t->values)
+            for (Cell *x : *t->values)
+                x->mark();
+    }
+    lock_guard<mutex> g(vm->lock);
+    for (Cell *f : vm->futures)
+        f->mark();
+}
 
 // Free memory for all unused objects.
 void VM::gc() {
-    int len = this->heap.size();
-    // Find out which objects are still in use.
-// The mark phase of garbage collection. Starting at the roots (in this case,
-// just the stack), recursively walks all reachable objects in the VM.
+    if (frozen)
+        return;
+    stop_tasks(this);
+    adopt_pending();
+    size_t len = heapCells();
+    trace_event(TraceGC, NULL, len);
+    // Helping with its own pool tasks while they wait for the collection
+    // would deadlock, so the VM's thread only spreads the work over the
+    // pool when it has none in flight.
+    bool parallel = len >= PARALLEL_GC_MIN && pool_size() > 1
+        && in_flight == 0;
+    size_t markers = parallel ? pool_size() : 1;
+
+    // The mark phase. The roots are the global environment, pending
+    // multiple values, whatever the C++ stacks of this thread and of the
+    // stopped tasks still point at, and the futures in flight; they are
+    // marked here, the rest of the graph by the markers.
+    parallel_sort(heap.data(), heap.size(), less<Cell*>(),
+                  parallel ? PARALLEL_GC_MIN : SIZE_MAX);
+    MarkState st(markers);
+    MarkStack *outer = marking;
+    marking = &st.stacks[0];
     root_env->mark();
-    // free the memories
-    auto it = this->heap.begin();
-    while(it != this->heap.end()) {
-        // If element is even number then delete it
-        if((*it)->in_use) {
-            it++;
-        } else {
-            (*it)->free_cell();
-            // Due to deletion in loop, iterator became
-            // invalidated. So reset the iterator to next item.
-            it = this->heap.erase(it);
-        }
+    for (Cell *sym : symbols)
+        sym->mark();
+    for (Cell *x : values_buffer)
+        x->mark();
+    mark_stack();
+    mark_tasks(this);
+    marking = outer;
+    if (parallel)
+        parallel_run(markers, [&st](size_t id) { run_marker(st, id); });
+    else
+        run_marker(st, 0);
+
+    // symbols that are not marked go with the sweep
+    for (auto it = symbol_table.begin(); it != symbol_table.end();)
+        it = it->second->in_use ? std::next(it) : symbol_table.erase(it);
+    sweep(heap, parallel, [this](Cell *cell) {
+        run_cells -= cell->run;
+        cell->free_cell();
+    });
+    root_env->in_use = false;
+
+    size_t live = heapCells();
+    gc_threshold = next_gc_threshold(heap_limits, live);
+    // what each task may allocate before it asks for the next collection
+    size_t room = gc_threshold > live ? gc_threshold - live : 0;
+    task_room = max(room, heap_limits.min / CELL_BYTES) / pool_size();
+    gc_wanted = false;
+    // a heap that has shrunk to less than half gives the memory back
+    if (len > 2 * live && len * CELL_BYTES > heap_limits.min) {
+        heap.shrink_to_fit();
+        malloc_trim(0);
     }
+    resume_tasks(this);
 
-    printf("%ld live bytes after collection.\n", len - this->heap.size());
+    infolog("%ld objects collected, %ld live.\n",
+            (long)(len - live), (long)live);
 }
 
+void VM::reserve() {
+    if (heapCells() < gc_threshold && !gc_wanted.load(memory_order_relaxed))
+        return;
+    gc();
+
+    // If there still isn't room after collection, we can't fit it.
+    // Some is left for handling the error, collecting again after.
+    size_t max = heap_limits.max / CELL_BYTES;
+    if (heapCells() >= max) {
+        gc_threshold = heapCells() + max / 16;
+        Cell *err = make_error(__func__, "out-of-memory", nil());
+        as_error(err)->tag = intern("out-of-memory");
+        throw_error(err);
+    }
+}
 
-Cell* VM::newObject() {
-    if (this->heap.size() > HEAP_SIZE) {
-        this->gc();
 
-        // If there still isn't room after collection, we can't fit it.
-        if (this->heap.size() > HEAP_SIZE) {
-            perror("Out of memory");
-            exit(1);
-        }
+Cell* VM::newObject() {
+    if (alloc_sink) {
+        Cell *object = new Cell();
+        alloc_sink->push_back(object);
+        if (alloc_sink->size() > task_room.load(memory_order_relaxed)
+            && !gc_wanted.load(memory_order_relaxed))
+            gc_wanted = true;
+        return object;
     }
+    reserve();
 
     Cell* object = new Cell();
     this->heap.push_back(object);
+    this->cells_allocated++;
     return object;
 }
 
+// The tasks the calling thread is running, innermost last, each with
+// the top of its stack: the frame it was entered from. A task that runs
+// another of its VM in place (a nested pcall, a touch claiming a future)
+// counts once in tasks_running, the thread is what stops.
+struct EnteredTask {
+    VM *vm;
+    void **top;
+};
+static thread_local vector<EnteredTask> entered;
+
+// the outermost task of vm on the calling thread, or NULL
+static EnteredTask *in_task(VM *vm) {
+    for (EnteredTask &t : entered)
+        if (t.vm == vm)
+            return &t;
+    return NULL;
+}
+
+// Only the frames a task pushed are scanned, the thread's stack above
+// them holds none of its cells (on a pool worker, the top of the stack
+// block is the thread's TLS, which it writes while stopped).
+__attribute__((noinline)) void VM::task_enter(List *sink) {
+    bool outer = !in_task(this);
+    entered.push_back({this, (void**)__builtin_frame_address(0)});
+    unique_lock<mutex> g(task_lock);
+    if (outer) {
+        task_cv.wait(g, [this] { return !stopping.load(); });
+        tasks_running++;
+    }
+    if (sink)
+        sinks.push_back(sink);
+}
+
+void VM::task_leave(List *sink) {
+    entered.pop_back();
+    bool outer = !in_task(this);
+    {
+        lock_guard<mutex> g(task_lock);
+        if (outer)
+            tasks_running--;
+        if (sink)
+            sinks.erase(find(sinks.begin(), sinks.end(), sink));
+    }
+    task_cv.notify_all();
+}
+
+void VM::add_sink(List *sink) {
+    lock_guard<mutex> g(task_lock);
+    sinks.push_back(sink);
+}
+
+void VM::drop_sink(List *sink) {
+    lock_guard<mutex> g(task_lock);
+    sinks.erase(find(sinks.begin(), sinks.end(), sink));
+}
+
+// Like mark_stack, the registers are spilled into this frame, which
+// stays put while the task is stopped; only what wait runs goes deeper.
+__attribute__((noinline)) void VM::task_pause(const function<void()> &wait,
+                                              bool values) {
+    if (!in_task(this)) {
+        wait();
+        return;
+    }
+    void **top = in_task(this)->top;
+    // the whole thread stops, the tasks wait runs enter afresh; the
+    // frame is not written while a collection may be scanning it
+    vector<EnteredTask> outer;
+    outer.swap(entered);
+    jmp_buf regs;
+    setjmp(regs);
+    StoppedTask self = {(void**)&regs, top,
+                        values ? &values_buffer : NULL};
+    {
+        lock_guard<mutex> g(task_lock);
+        tasks_running--;
+        stopped.push_back(&self);
+    }
+    task_cv.notify_all();
+    wait();
+    unique_lock<mutex> g(task_lock);
+    task_cv.wait(g, [this] { return !stopping.load(); });
+    stopped.erase(find(stopped.begin(), stopped.end(), &self));
+    tasks_running++;
+    outer.swap(entered);
+}
+
+Environment* VM::makeEnv(Environment *parent) {
+    if (!alloc_sink)
+        reserve();
+    Environment *env = new Environment(parent);
+    if (alloc_sink) {
+        alloc_sink->push_back(env);
+    } else {
+        heap.push_back(env);
+        cells_allocated++;
+    }
+    return env;
+}
+
+Cell* VM::makeList(size_t n) {
+    Cell *list = nil();
+    Cell *last = NULL;
+    while (n > 0) {
+        size_t len = n < RUN_MIN ? 1 : min(n, (size_t)RUN_MAX);
+        n -= len;
+        Cell *run;
+        if (len == 1) {
+            run = newObject();
+            run->type = TypePair;
+            run->val = nil();
+            run->next = nil();
+        } else {
+            if (!alloc_sink)
+                reserve();
+#if LISP_COMPRESSED_REFS
+            run = (Cell*)arena_alloc_run(len);
+#else
+            run = (Cell*)malloc(len * sizeof(Cell));
+#endif
+            for (size_t i = 0; i < len; i++)
+                ::new (&run[i]) Cell(TypePair, nil(),
+                                   i + 1 < len ? &run[i + 1] : nil());
+            run->run = len - 1;
+            run_cells += len - 1;
+            if (alloc_sink) {
+                alloc_sink->push_back(run);
+            } else {
+                heap.push_back(run);
+                cells_allocated += len;
+            }
+        }
+        if (last)
+            last->next = run;
+        else
+            list = run;
+        last = &run[len - 1];
+    }
+    return list;
+}
+
 Cell* VM::makeCell(LispType type, void* data, Cell* y) {
     Cell *_cell = this->newObject();
     debuglog("type=%d, %p\n", type, data);
@@ -134,6 +847,7 @@ Cell* VM::makeCell(LispType type, void* data, Cell* y) {
     _cell->type = type;
     _cell->val = data;
     _cell->next = y;
+    trace_event(TraceAlloc, _cell, data);
     return _cell;
 }
 
@@ -149,6 +863,14 @@ Cell* VM::makeCell(LispType type, void* data, Cell* y) {
 //     return _pair;
 // }
 
+string Cell::as_string() {
+    if (type == TypeString)
+        return string(string_chars(this), string_len(this));
+    if (type == TypeSymbol)
+        return string((char*)(this->val));
+    error("trying to access as string", this);
+}
+
 int Cell::count_obj() {
     Cell* cell = this;
     if (null(cell))
@@ -173,23 +895,33 @@ int Cell::count_obj() {
 
 Cell *VM::getSymbol(const char *sym) {
     // if (sym == NULL) return symbols;
+    // only locked while pool workers may be interning too
+    std::unique_lock<std::mutex> guard(this->lock, std::defer_lock);
+    if (this->in_flight)
+        guard.lock();
 
     /* debuglog("interning symbol %s\n", sym); */
-    return_if_find_item_in_list(symbols, [sym](Cell* symbol) {
-            return strncmp(sym, symbol->as_char_str(), 32) == 0;
-        });
-    // dolist_cdr(_pair, symbols) {
-    //     /* debuglog("interning symbol, %p, %p|\n", car(_pair), cdr(_pair)); */
-    //     if (car(_pair)
-    //         && strncmp(sym, (char*)((Cell*)car(_pair))->val, 32) == 0)
-    //         return (Cell*)car(_pair);
-    // }
-
-    Cell *newSym = new Cell(TypeSymbol, strdup(sym));
+    // the symbols of frozen templates never change, no lock needed
+    for (VM *b = base; b; b = b->base) {
+        auto found = b->symbol_table.find(sym);
+        if (found != b->symbol_table.end())
+            return found->second;
+    }
+    auto found = symbol_table.find(sym);
+    if (found != symbol_table.end())
+        return found->second;
+
+    // may collect, which only drops other symbols and takes the lock
+    bool locked = guard.owns_lock();
+    if (locked)
+        guard.unlock();
+    Cell *newSym = makeCell(TypeSymbol, NULL, NULL);
+    newSym->val = strdup(sym);
     debuglog("creating new symbol %s\n", sym);
-    // symbols = cons(newSym, symbols);
-    symbols.push_back(newSym);
-    return newSym;
+    if (locked)
+        guard.lock();
+    // a task may have interned it meanwhile, its symbol is the one
+    return symbol_table.emplace(newSym->as_char_str(), newSym).first->second;
 }
 
 bool equal(Cell *x, Cell *y) {
@@ -199,6 +931,7 @@ bool equal(Cell *x, Cell *y) {
     if (x->type == y->type) {
         switch(x->type) {
         case TypeString:
+            return string_equal(x, y);
         case TypeSymbol:
             return string_eq(x->val, y->val);
         case TypePair:
@@ -208,11 +941,14 @@ bool equal(Cell *x, Cell *y) {
                              cdr(y)));
         case TypeInt:
         case TypeFixNum:
-            return x->as_int() == y->as_int();
+            return x->as_long() == y->as_long();
         case TypeFloat:
-            return x->as_float() == y->as_float();
+        case TypeBigNum:
         case TypeRatio:
-            TODO("implement strust of ratio w {denom, detanator}");
+            return num_equal(x, y);
+        case TypeF64Vector:
+        case TypeS64Vector:
+            return numvector_equal(x, y);
         default:
             TODO("should raise error for undefined type?")
             return x->val == y->val;
@@ -236,47 +972,12 @@ Cell *assoc(Cell *sym, Cell *alist) {
     return nil();
 }
 
-ostream& operator<<(ostream &out, Cell *exp) {
-    if (null(exp)) {
-        out << "nil";
-    }
-    else if (is_symbol(exp) || is_string(exp) || is_error(exp)) {
-        out << (char *)exp->val;
-    }
-    // check procedure before list
-    else if (is_procedure(exp)) {
-        out << "<Proc " << (void *)exp << ">";
-    }
-    else if (is_pair(exp)) {
-        out << "(" << car(exp);
-        /* debuglog("print_expr: %s, %d\n", ((Cell*)car(exp))->val, ((Cell*)car(exp))->type); */
-        /* debuglog("print_expr: mid %p, %d\n", (exp)->next, exp->type); */
-        Cell *e = cdr(exp);
-        /* debuglog("print_expr: after %d, %d\n", e->next == NULL, e->type); */
-        if (!null(e) && is_atom(e)) {
-            // print cons
-            cout << " . " << e << ")";
-        } else {
-            // print normal list
-            for (; e && !null(e); e = cdr(e)) {
-                cout << " " << car(e);
-            }
-            cout << ")";
-        }
-    }
-    else if (is_integer(exp)) {
-        cout << exp->as_int();
-    }
-    else if (is_float(exp)) {
-        cout << exp->as_float();
-    }
-    else if (is_primitive(exp)) {
-        out << "<Prim " << prim_name(exp) << " " << (void*)exp << ">";
-    }
-    else {
-        out << __func__ << ": unsupported exp type=" << exp->type;
+Cell *reverse(Cell *l) {
+    Cell *acc = nil();
+    dolist_cdr(c, l) {
+        acc = cons(car(c), acc);
     }
-    return out;
+    return acc;
 }
 
 int length(Cell *list) {
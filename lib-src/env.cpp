@@ -2,32 +2,49 @@
 #include "env.hpp"
 #include "reader.hpp"
 #include "data.hpp"
+#include "trace.hpp"
+#include "error.hpp"
+#include "number.hpp"
+#include "vector.hpp"
+#include "hashtable.hpp"
+#include "lstring.hpp"
+#include "list.hpp"
+#include "pool.hpp"
+#include "stream.hpp"
+#include "values.hpp"
+#include "port.hpp"
+#include "future.hpp"
+#include "green.hpp"
+#include "limits.hpp"
+#include "heap.hpp"
 #include <iostream>
 
-Environment::Environment(VM* vm,
-                         vector<pair<const char*, PrimLispFn>> prim_pairs) :
+Environment::Environment(VM* vm, prim_pairs prims) :
     Environment()
 {
+    this->add_prims(vm, prims);
+}
+
+void Environment::add_prims(VM* vm, prim_pairs prims) {
 #define VM_CONS(x, y) vm->makeCell(TypePair, x, y)
-    for (auto& pair : prim_pairs) {
+    for (auto& pair : prims) {
         const char* name = pair.first;
         PrimLispFn def = pair.second;
 
         Cell *prim_name = vm->getSymbol(name); 
-        Cell *prim_def = new Cell(TypePrim, (void*)def, (Cell*)name);
-        this->frame = VM_CONS(VM_CONS(prim_name, prim_def), this->frame);
+        Cell *prim_def = vm->makeCell(TypePrim, (void*)def, NULL);
+        set_prim_name(prim_def, name);
+        this->set_frame(VM_CONS(VM_CONS(prim_name, prim_def), this->frame()));
     }
 }
 
-void Environment::mark() {
-    frame->mark();
-    if (!this->is_root())
-        this->parent->mark();
+Environment* Environment::extend() {
+    return getVM()->makeEnv(this);
 }
 
 int Environment::count_obj() {
-    return this->frame->count_obj()
-        + (this->is_root() ? 0 : this->parent->count_obj());
+    return this->frame()->count_obj()
+        + (this->is_root() ? 0 : this->parent()->count_obj());
 }
 
 Environment *init_environment(VM* vm) {
@@ -40,6 +57,22 @@ Environment *init_environment(VM* vm) {
         }),
         make_pair("car", +[](Cell* args) { return car((Cell*)car(args));}),
         make_pair("cdr", +[](Cell* args) { return cdr((Cell*)car(args));}),
+        make_pair("set-car!", +[](Cell* args) {
+            Cell *pair = car(args);
+            if (!is_pair(pair))
+                return_error("not a pair", pair);
+            check_mutable(pair);
+            pair->set_car(cadr(args));
+            return nil();
+        }),
+        make_pair("set-cdr!", +[](Cell* args) {
+            Cell *pair = car(args);
+            if (!is_pair(pair))
+                return_error("not a pair", pair);
+            check_mutable(pair);
+            pair->set_cdr(cadr(args));
+            return nil();
+        }),
         make_pair("eq", +[](Cell* args) {
             return to_lisp_bool((Cell*)car(args) == (Cell*)cadr(args));
         }),
@@ -52,6 +85,21 @@ Environment *init_environment(VM* vm) {
         })
     };
     Environment *env = new Environment(vm, x);
+    env->add_prims(vm, trace_prims());
+    env->add_prims(vm, error_prims());
+    env->add_prims(vm, number_prims());
+    env->add_prims(vm, vector_prims());
+    env->add_prims(vm, hashtable_prims());
+    env->add_prims(vm, string_prims());
+    env->add_prims(vm, list_prims());
+    env->add_prims(vm, parallel_prims());
+    env->add_prims(vm, stream_prims());
+    env->add_prims(vm, values_prims());
+    env->add_prims(vm, port_prims());
+    env->add_prims(vm, future_prims());
+    env->add_prims(vm, green_prims());
+    env->add_prims(vm, limits_prims());
+    env->add_prims(vm, heap_prims());
 
 #define DEF_PRIM_FN(name, def) ({                                       \
             static Cell prim_name = Cell(TypeSymbol, ((void*)name));            \
@@ -64,10 +112,20 @@ Environment *init_environment(VM* vm) {
 
 #define make_bind(var, val) cons(var, val)
 
+// The globals of a frozen template (see VM::freeze) are reached through
+// the root of the VM cloned from it, whose frame ends in theirs; this is
+// what lets a clone rebind them.
+static Environment *own_root(Environment *env) {
+    return env->is_root() && is_frozen(env) ? getVM()->root_env : env;
+}
+
 Cell *env_add_var_def(Cell *var, Cell *val, Environment *env) {
     // Only calling from eval, and is checked, so redundant
     // ensure(var, TypeSymbol);
-    Cell *frame = env->frame;
+    env = own_root(env);
+    if (is_frozen(env))
+        error("environment belongs to a frozen template", var);
+    Cell *frame = env->frame();
     // check if at root frame
     if (env->is_root()) {
         /* debuglog("top level def %p\n", env); */
@@ -75,7 +133,10 @@ Cell *env_add_var_def(Cell *var, Cell *val, Environment *env) {
     } else {
         /* debuglog("nested def %p\n", env); */
     }
-    env->frame = cons(make_bind(var, val), frame);
+    // published with release, so a future reading this frame on another
+    // thread sees a complete binding
+    __atomic_store_n(&env->val, (void*)cons(make_bind(var, val), frame),
+                     __ATOMIC_RELEASE);
     return val;
 }
 
@@ -83,8 +144,10 @@ Cell *env_lookup_var(Cell *var, Environment *env) {
     // Same reason as above, in env_add_var_def
     // ensure(var, TypeSymbol);
     /* debuglog("length of env, %p\n", env->type); */
+    env = own_root(env);
 
-    Cell *pair = assoc(var, env->frame);
+    Cell *pair = assoc(var,
+                       (Cell*)__atomic_load_n(&env->val, __ATOMIC_ACQUIRE));
     if (!null(pair)) {
         /* debuglog("variable found, %s\n", (char*)var->val); */
         Cell *def = cdr(pair);
@@ -94,24 +157,31 @@ Cell *env_lookup_var(Cell *var, Environment *env) {
         return def;
     }
     else if (!env->is_root()) {
-        return env_lookup_var(var, env->parent);
+        return env_lookup_var(var, env->parent());
     }
-    return_error("variable not defined, %s\n", (char*)var->val);
+    return_error("variable not defined", var);
 }
 
 Cell *env_set_variable_value(Cell *var, Cell *val, Environment *env) {
     ensure(var, TypeSymbol);
 
-    Cell *pair = assoc(var, env->frame);
+    env = own_root(env);
+    Cell *pair = assoc(var, env->frame());
     if (!null(pair)) {
+        if (is_frozen(pair)) {
+            // copied on write, into the clone's own frame
+            if (env->is_root() && !is_frozen(env))
+                return env_add_var_def(var, val, env);
+            return_error("binding belongs to a frozen template", var);
+        }
         pair->set_cdr(val);
         return val;
     }
     else if (!env->is_root()) {
-        return env_set_variable_value(var, val, env->parent);
+        return env_set_variable_value(var, val, env->parent());
     }
         
-    return_error("variable not defined, %s\n", (char*)var->val);
+    return_error("variable not defined", var);
     // return nil();
 }
 
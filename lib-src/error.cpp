@@ -0,0 +1,48 @@
+
+#include <execinfo.h>
+#include "error.hpp"
+#include "lstring.hpp"
+
+Cell *make_error(const char *where, const char *msg, Cell *irritant) {
+    LispError *err = new LispError();
+    err->where = where;
+    err->msg = msg;
+    err->tag = nil();
+    err->irritant = irritant ? irritant : nil();
+    // raw addresses only, skipping make_error itself
+    err->depth = backtrace(err->frames, ERROR_TRACE_MAX);
+    if (err->depth > 0) {
+        err->depth--;
+        memmove(err->frames, err->frames + 1, err->depth * sizeof(void*));
+    }
+    return make_cell(TypeError, err);
+}
+
+void LispError::mark() {
+    tag->mark();
+    irritant->mark();
+}
+
+void throw_error(Cell *err) {
+    throw LispException{err};
+}
+
+prim_pairs error_prims() {
+    return {
+        // (error tag [irritant]), tag is a symbol or a string
+        make_pair("error", +[](Cell* args) {
+            Cell *tag = car(args);
+            if (!is_symbol(tag) && !is_string(tag))
+                return_error("error tag must be a symbol or string", tag);
+            Cell *irritant = null(cdr(args)) ? nil() : cadr(args);
+            // msg points into the tag, a view's chars are not terminated
+            if (is_string(tag) && as_lstring(tag)->is_view())
+                tag = make_string(string_chars(tag), string_len(tag));
+            const char *msg = is_string(tag) ? string_chars(tag)
+                                             : tag->as_char_str();
+            Cell *err = make_error("error", msg, irritant);
+            as_error(err)->tag = tag;
+            return err;
+        }),
+    };
+}
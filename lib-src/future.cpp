@@ -0,0 +1,124 @@
+
+#include "future.hpp"
+#include "pool.hpp"
+#include "lisp.hpp"
+#include "error.hpp"
+#include "values.hpp"
+
+void Future::mark() {
+    value->mark();
+    exp->mark();
+    if (env)
+        env->mark();
+}
+
+// Evaluates f on the calling thread. The cells it allocates are handed
+// to the VM, which moves them into its heap before the next collection.
+static void run_future(Future *f) {
+    VMScope scope(f->vm);
+    List *outer = alloc_sink;
+    alloc_sink = &f->cells;
+    f->vm->task_enter(&f->cells);
+    Cell *value = eval_toplevel(f->exp, f->env);
+
+    // the values buffer is this thread's, keep the first value
+    f->value = first_value(value);
+    f->exp = nil();
+    f->env = NULL;
+    {
+        lock_guard<mutex> guard(f->vm->lock);
+        f->vm->pending.insert(f->vm->pending.end(),
+                              f->cells.begin(), f->cells.end());
+    }
+    f->cells.clear();
+    f->vm->task_leave(&f->cells);
+    alloc_sink = outer;
+    f->state.store(FutureDone, memory_order_release);
+}
+
+// claims f for the calling thread, false when it has been started
+static bool claim(Future *f) {
+    int expected = FuturePending;
+    return f->state.compare_exchange_strong(expected, FutureRunning);
+}
+
+Cell *touch(Cell *x) {
+    if (!is_future(x))
+        return x;
+    Future *f = as_future(x);
+    if (claim(f)) {
+        run_future(f);
+    } else {
+        help_until([f] {
+            return f->state.load(memory_order_acquire) == FutureDone;
+        });
+    }
+    return f->value;
+}
+
+// (future exp)
+Cell *eval_future(Cell *exp, Environment *env) {
+    VM *vm = getVM();
+    Future *f = new Future(cadr(exp), env, vm);
+    Cell *cell = make_cell(TypeFuture, f);
+    // the future stays uncollected until its task has left the queue,
+    // even when a touch ran it first
+    vm->in_flight++;
+    {
+        lock_guard<mutex> guard(vm->lock);
+        vm->futures.insert(cell);
+    }
+    spawn([cell, f, vm] {
+        if (claim(f))
+            run_future(f);
+        {
+            lock_guard<mutex> guard(vm->lock);
+            vm->futures.erase(cell);
+        }
+        vm->in_flight--;
+    });
+    return cell;
+}
+
+// (pcall f a b ...)
+Cell *eval_pcall(Cell *exp, Environment *env) {
+    Cell *fn = eval(cadr(exp), env);
+    if (is_error(fn))
+        return fn;
+
+    // the argument list is made first, the tasks fill in its cars
+    vector<Cell*> exps, slots;
+    dolist_cdr(c, cddr(exp)) {
+        exps.push_back(car(c));
+    }
+    Cell *args = nil();
+    for (size_t i = 0; i < exps.size(); i++)
+        args = cons(nil(), args);
+    dolist_cdr(c, args) {
+        slots.push_back(c);
+    }
+
+    parallel_run(exps.size(), [&](size_t i) {
+        Cell *val = eval(exps[i], env);
+        if (is_error(val))
+            throw_error(val);
+        slots[i]->set_car(first_value(val));
+    });
+    return apply(fn, args);
+}
+
+prim_pairs future_prims() {
+    return {
+        make_pair("touch", +[](Cell* args) {
+            return touch(car(args));
+        }),
+        make_pair("future?", +[](Cell* args) {
+            return to_lisp_bool(is_future(car(args)));
+        }),
+        make_pair("future-done?", +[](Cell* args) {
+            return to_lisp_bool(!is_future(car(args))
+                                || as_future(car(args))->state.load()
+                                   == FutureDone);
+        }),
+    };
+}
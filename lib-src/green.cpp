@@ -0,0 +1,333 @@
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "green.hpp"
+#include "lisp.hpp"
+#include "error.hpp"
+#include "number.hpp"
+#include "values.hpp"
+#include "limits.hpp"
+
+GreenThread::GreenThread(Cell *thunk) :
+    stack(NULL), sp(NULL), state(GreenReady), thunk(thunk), result(nil()),
+    slot(0), wait_fd(-1), wait_events(0)
+{
+    // the pages are only backed once touched
+    void *mem = mmap(NULL, GREEN_STACK_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+                     -1, 0);
+    if (mem == MAP_FAILED)
+        error("cannot allocate a green thread stack", nil());
+    stack = (char*)mem;
+    // the guard page
+    mprotect(stack, getpagesize(), PROT_NONE);
+}
+
+GreenThread::~GreenThread() {
+    release_stack();
+}
+
+void GreenThread::release_stack() {
+    if (stack)
+        munmap(stack, GREEN_STACK_SIZE);
+    stack = NULL;
+    sp = NULL;
+}
+
+void GreenThread::mark() {
+    thunk->mark();
+    result->mark();
+}
+
+void Channel::mark() {
+    for (Cell *x : items)
+        x->mark();
+}
+
+// the scheduler of the calling thread's VM
+static GreenScheduler *scheduler() {
+    if (alloc_sink)
+        error("green threads only run on the VM's own thread", nil());
+    VM *vm = getVM();
+    if (vm->green == NULL)
+        vm->green = new GreenScheduler();
+    return vm->green;
+}
+
+static void wake(GreenScheduler *s, GreenThread *g) {
+    g->state = GreenReady;
+    s->ready.push_back(g);
+}
+
+// Switches from the running green thread back to the VM's stack, with
+// g->state already saying why.
+static void switch_out(GreenScheduler *s, GreenThread *g) {
+    void *here;
+    g->sp = (void**)&here;
+    swapcontext(&g->ctx, &s->vm_ctx);
+}
+
+static void park(GreenScheduler *s, GreenThread *g) {
+    g->state = GreenBlocked;
+    switch_out(s, g);
+}
+
+static void green_main() {
+    GreenScheduler *s = getVM()->green;
+    GreenThread *g = s->current;
+    try {
+        g->result = first_value(apply(g->thunk, nil()));
+    } catch (LispException &e) {
+        g->result = e.err;
+    } catch (std::exception &e) {
+        g->result = make_error(__func__, "green thread failed", nil());
+    }
+    g->thunk = nil();
+    g->state = GreenDone;
+    for (GreenThread *j : g->joiners)
+        wake(s, j);
+    g->joiners.clear();
+    switch_out(s, g);
+}
+
+// Runs g until it gives way, from the VM's stack. A finished thread
+// gives back its stack and stops being a root.
+static void run(GreenScheduler *s, GreenThread *g) {
+    void *here;
+    s->vm_sp = (void**)&here;
+    s->current = g;
+    g->state = GreenRunning;
+    char *floor = stack_floor;
+    stack_floor = g->stack + getpagesize() + STACK_MARGIN;
+    swapcontext(&s->vm_ctx, &g->ctx);
+    stack_floor = floor;
+    s->current = NULL;
+    if (g->state != GreenDone)
+        return;
+    g->release_stack();
+    Cell *last = s->threads.back();
+    s->threads[g->slot] = last;
+    as_green_thread(last)->slot = g->slot;
+    s->threads.pop_back();
+}
+
+static bool fd_ready(int fd, short events) {
+    struct pollfd p = {fd, events, 0};
+    return poll(&p, 1, 0) > 0;
+}
+
+// Wakes the threads whose reads can go on, waiting up to timeout ms for
+// one of them, or for fd, the VM stack's own read.
+static void poll_parked(GreenScheduler *s, int timeout, int fd, short events) {
+    vector<struct pollfd> fds;
+    for (GreenThread *g : s->io_waiting)
+        fds.push_back({g->wait_fd, g->wait_events, 0});
+    if (fd >= 0)
+        fds.push_back({fd, events, 0});
+    if (fds.empty())
+        return;
+    int n;
+    do {
+        n = poll(fds.data(), fds.size(), timeout);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+        return;
+    size_t kept = 0;
+    for (size_t i = 0; i < s->io_waiting.size(); i++) {
+        GreenThread *g = s->io_waiting[i];
+        if (fds[i].revents)
+            wake(s, g);
+        else
+            s->io_waiting[kept++] = g;
+    }
+    s->io_waiting.resize(kept);
+}
+
+// Runs green threads on the VM's stack until done() holds, false when
+// nothing is left that could make it hold. fd, if any, is the read the
+// VM's stack waits for; with no thread ready the wait blocks in poll.
+static bool run_until(GreenScheduler *s, const function<bool()> &done,
+                      int fd = -1, short events = 0) {
+    while (!done()) {
+        if (s->ready.empty() && s->io_waiting.empty() && fd < 0)
+            return false;
+        poll_parked(s, s->ready.empty() ? -1 : 0, fd, events);
+        if (!s->ready.empty()) {
+            GreenThread *g = s->ready.front();
+            s->ready.pop_front();
+            run(s, g);
+        }
+    }
+    return true;
+}
+
+// Waits until done() holds: a green thread parks in queue, to be woken
+// by whoever changes what done() tests; the VM's stack runs the others.
+template<typename Queue>
+static void wait_for(GreenScheduler *s, Queue &queue,
+                     const function<bool()> &done, Cell *irritant) {
+    while (!done()) {
+        if (s->current) {
+            queue.push_back(s->current);
+            park(s, s->current);
+        } else if (!run_until(s, done)) {
+            error("no green thread left to wake this one", irritant);
+        }
+    }
+}
+
+void **green_stack_top(VM *vm) {
+    GreenScheduler *s = vm->green;
+    return s && s->current ? s->current->stack_top() : NULL;
+}
+
+void green_mark_roots(VM *vm, void **vm_stack_top) {
+    GreenScheduler *s = vm->green;
+    if (s == NULL)
+        return;
+    for (Cell *t : s->threads) {
+        t->mark();
+        GreenThread *g = as_green_thread(t);
+        // the registers are saved in ctx when switched out
+        if (g != s->current && g->sp) {
+            vm->mark_range(g->sp, g->stack_top());
+            vm->mark_range((void**)&g->ctx, (void**)(&g->ctx + 1));
+        }
+    }
+    if (s->current) {
+        vm->mark_range(s->vm_sp, vm_stack_top);
+        vm->mark_range((void**)&s->vm_ctx, (void**)(&s->vm_ctx + 1));
+    }
+}
+
+void green_wait_fd(int fd, short events) {
+    if (alloc_sink)
+        return;
+    GreenScheduler *s = getVM()->green;
+    if (s == NULL || s->threads.empty() || fd_ready(fd, events))
+        return;
+    if (s->current) {
+        s->current->wait_fd = fd;
+        s->current->wait_events = events;
+        s->io_waiting.push_back(s->current);
+        park(s, s->current);
+    } else {
+        run_until(s, [fd, events] { return fd_ready(fd, events); },
+                  fd, events);
+    }
+}
+
+static Cell *green_spawn(Cell *thunk) {
+    if (!is_procedure(thunk) && !is_primitive(thunk))
+        return_error("not a procedure", thunk);
+    GreenScheduler *s = scheduler();
+    GreenThread *g = new GreenThread(thunk);
+    Cell *cell = make_cell(TypeGreenThread, g);
+    getcontext(&g->ctx);
+    g->ctx.uc_stack.ss_sp = g->stack + getpagesize();
+    g->ctx.uc_stack.ss_size = GREEN_STACK_SIZE - getpagesize();
+    g->ctx.uc_link = NULL;
+    makecontext(&g->ctx, green_main, 0);
+    g->slot = s->threads.size();
+    s->threads.push_back(cell);
+    wake(s, g);
+    return cell;
+}
+
+static void green_yield() {
+    GreenScheduler *s = scheduler();
+    if (s->current) {
+        wake(s, s->current);
+        switch_out(s, s->current);
+        return;
+    }
+    // one round of the threads ready now
+    poll_parked(s, 0, -1, 0);
+    for (size_t n = s->ready.size(); n > 0 && !s->ready.empty(); n--) {
+        GreenThread *g = s->ready.front();
+        s->ready.pop_front();
+        run(s, g);
+    }
+}
+
+static Cell *green_join(Cell *thread) {
+    if (!is_green_thread(thread))
+        return_error("not a green thread", thread);
+    GreenScheduler *s = scheduler();
+    GreenThread *g = as_green_thread(thread);
+    if (g == s->current)
+        return_error("a green thread cannot join itself", thread);
+    wait_for(s, g->joiners, [g] { return g->state == GreenDone; }, thread);
+    return g->result;
+}
+
+static Channel *check_channel(Cell *x) {
+    if (!is_channel(x))
+        error("not a channel", x);
+    return as_channel(x);
+}
+
+static Cell *channel_send(Cell *chan, Cell *x) {
+    Channel *ch = check_channel(chan);
+    GreenScheduler *s = scheduler();
+    wait_for(s, ch->senders, [ch] { return ch->items.size() < ch->cap; },
+             chan);
+    ch->items.push_back(x);
+    if (!ch->receivers.empty()) {
+        wake(s, ch->receivers.front());
+        ch->receivers.pop_front();
+    }
+    return x;
+}
+
+static Cell *channel_recv(Cell *chan) {
+    Channel *ch = check_channel(chan);
+    GreenScheduler *s = scheduler();
+    wait_for(s, ch->receivers, [ch] { return !ch->items.empty(); }, chan);
+    Cell *x = ch->items.front();
+    ch->items.pop_front();
+    if (!ch->senders.empty()) {
+        wake(s, ch->senders.front());
+        ch->senders.pop_front();
+    }
+    return x;
+}
+
+prim_pairs green_prims() {
+    return {
+        make_pair("spawn", +[](Cell* args) {
+            return green_spawn(car(args));
+        }),
+        make_pair("yield", +[](Cell* args) {
+            green_yield();
+            return nil();
+        }),
+        make_pair("join", +[](Cell* args) {
+            return green_join(car(args));
+        }),
+        make_pair("green-thread?", +[](Cell* args) {
+            return to_lisp_bool(is_green_thread(car(args)));
+        }),
+        // (make-channel [n]), buffers up to n values
+        make_pair("make-channel", +[](Cell* args) {
+            long cap = 1;
+            if (!null(args)) {
+                if (!is_integer(car(args)) || car(args)->as_long() < 1)
+                    return_error("not a channel size", car(args));
+                cap = car(args)->as_long();
+            }
+            return make_cell(TypeChannel, new Channel(cap));
+        }),
+        make_pair("channel?", +[](Cell* args) {
+            return to_lisp_bool(is_channel(car(args)));
+        }),
+        make_pair("send", +[](Cell* args) {
+            return channel_send(car(args), cadr(args));
+        }),
+        make_pair("recv", +[](Cell* args) {
+            return channel_recv(car(args));
+        }),
+    };
+}
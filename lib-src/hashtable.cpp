@@ -0,0 +1,305 @@
+
+#include "hashtable.hpp"
+#include "number.hpp"
+#include "vector.hpp"
+#include "lstring.hpp"
+
+// power of two, buckets are picked by masking the hash
+#define HASH_MIN_BUCKETS 8
+// buckets moved over by each operation while a resize is in progress
+#define HASH_REHASH_STEP 4
+// equal_hash looks at most this deep / this many elements per level
+#define HASH_MAX_DEPTH 8
+#define HASH_MAX_ELTS 32
+
+// splitmix64 finalizer, spreads pointers and small integers over the bits
+// the bucket mask keeps
+static size_t mix(size_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+#define hash_combine(h, x) (((h) ^ (x)) * 0x100000001b3ULL)
+
+size_t eq_hash(Cell *x) {
+    return mix((size_t)x);
+}
+
+static size_t str_hash(const char *s, size_t len) {
+    size_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++)
+        h = hash_combine(h, (unsigned char)s[i]);
+    return h;
+}
+
+static size_t numvector_hash(Cell *x) {
+    NumVector *vec = as_numvector(x);
+    size_t h = vec->len;
+    for (size_t i = 0; i < vec->len && i < HASH_MAX_ELTS; i++) {
+        // 0.0 and -0.0 compare equal
+        int64_t bits = vec->s64()[i];
+        if (is_f64vector(x) && vec->f64()[i] == 0)
+            bits = 0;
+        h = hash_combine(h, (size_t)bits);
+    }
+    return h;
+}
+
+static size_t equal_hash_at(Cell *x, int depth) {
+    if (null(x))
+        return 0;
+    switch (x->type) {
+    case TypeString:
+        return str_hash(string_chars(x), string_len(x));
+    case TypeSymbol:
+        return str_hash(x->as_char_str(), strlen(x->as_char_str()));
+    case TypeInt:
+    case TypeFixNum:
+    case TypeFloat:
+    case TypeBigNum:
+    case TypeRatio:
+        return mix(num_hash(x));
+    case TypeF64Vector:
+    case TypeS64Vector:
+        return mix(numvector_hash(x));
+    case TypePair: {
+        size_t h = 0x9e3779b97f4a7c15ULL;
+        if (depth == 0)
+            return h;
+        int n = 0;
+        for (; is_pair(x) && n < HASH_MAX_ELTS; x = cdr(x), n++)
+            h = hash_combine(h, equal_hash_at(car(x), depth - 1));
+        // dotted tail
+        if (!is_pair(x) && !null(x))
+            h = hash_combine(h, equal_hash_at(x, depth - 1));
+        return mix(h);
+    }
+    default:
+        // equal falls back to comparing val
+        return mix((size_t)x->val);
+    }
+}
+
+size_t equal_hash(Cell *x) {
+    return equal_hash_at(x, HASH_MAX_DEPTH);
+}
+
+//
+
+HashTable::HashTable(HashKind kind) : kind(kind), count(0), rehash_idx(0) {
+    buckets[0].assign(HASH_MIN_BUCKETS, NULL);
+}
+
+HashTable::~HashTable() {
+    each([](HashEntry *e) { delete e; });
+}
+
+size_t HashTable::hash(Cell *key) {
+    return kind == HashEq ? eq_hash(key) : equal_hash(key);
+}
+
+bool HashTable::same(Cell *x, Cell *y) {
+    return kind == HashEq ? x == y : equal(x, y);
+}
+
+// Move up to n chains from buckets[0] into buckets[1]. Runs of empty
+// buckets are bounded too, so a step never walks a sparse table end to end.
+void HashTable::rehash_step(int n) {
+    vector<HashEntry*> &from = buckets[0], &to = buckets[1];
+    size_t mask = to.size() - 1;
+    int empty_visits = n * 10;
+
+    while (n > 0 && rehash_idx < from.size()) {
+        HashEntry *e = from[rehash_idx];
+        if (e == NULL) {
+            rehash_idx++;
+            if (--empty_visits == 0)
+                break;
+            continue;
+        }
+        while (e) {
+            HashEntry *next = e->next;
+            e->next = to[e->hash & mask];
+            to[e->hash & mask] = e;
+            e = next;
+        }
+        from[rehash_idx++] = NULL;
+        n--;
+    }
+
+    if (rehash_idx == from.size()) {
+        from.swap(to);
+        vector<HashEntry*>().swap(to);
+        rehash_idx = 0;
+    }
+}
+
+void HashTable::finish_rehash() {
+    while (rehashing())
+        rehash_step(buckets[0].size());
+}
+
+// the link pointing at key's entry, NULL when absent
+HashEntry **HashTable::slot(Cell *key, size_t h) {
+    for (int t = 0; t < (rehashing() ? 2 : 1); t++) {
+        vector<HashEntry*> &b = buckets[t];
+        for (HashEntry **p = &b[h & (b.size() - 1)]; *p; p = &(*p)->next) {
+            if ((*p)->hash == h && same((*p)->key, key))
+                return p;
+        }
+    }
+    return NULL;
+}
+
+HashEntry *HashTable::find(Cell *key) {
+    if (rehashing())
+        rehash_step(HASH_REHASH_STEP);
+    HashEntry **p = slot(key, hash(key));
+    return p ? *p : NULL;
+}
+
+void HashTable::put(Cell *key, Cell *val) {
+    if (rehashing())
+        rehash_step(HASH_REHASH_STEP);
+    size_t h = hash(key);
+    HashEntry **p = slot(key, h);
+    if (p) {
+        (*p)->val = val;
+        return;
+    }
+
+    // load factor 1, start moving into a table twice the size
+    if (!rehashing() && count >= buckets[0].size()) {
+        buckets[1].assign(buckets[0].size() * 2, NULL);
+        rehash_idx = 0;
+    }
+    vector<HashEntry*> &b = buckets[rehashing() ? 1 : 0];
+    HashEntry *&head = b[h & (b.size() - 1)];
+    head = new HashEntry{key, val, h, head};
+    count++;
+}
+
+bool HashTable::remove(Cell *key) {
+    if (rehashing())
+        rehash_step(HASH_REHASH_STEP);
+    HashEntry **p = slot(key, hash(key));
+    if (p == NULL)
+        return false;
+    HashEntry *e = *p;
+    *p = e->next;
+    delete e;
+    count--;
+    return true;
+}
+
+void HashTable::clear() {
+    each([](HashEntry *e) { delete e; });
+    buckets[0].assign(HASH_MIN_BUCKETS, NULL);
+    vector<HashEntry*>().swap(buckets[1]);
+    rehash_idx = 0;
+    count = 0;
+}
+
+void HashTable::mark() {
+    each([](HashEntry *e) {
+        e->key->mark();
+        e->val->mark();
+    });
+}
+
+Cell *make_hashtable(HashKind kind) {
+    return make_cell(TypeHashTable, new HashTable(kind));
+}
+
+//
+
+static HashTable *check_table(Cell *x) {
+    if (!is_hashtable(x))
+        error("not a hash table", x);
+    return as_hashtable(x);
+}
+
+// a table that may be written to
+static HashTable *mutable_table(Cell *x) {
+    HashTable *table = check_table(x);
+    check_mutable(x);
+    return table;
+}
+
+// hashes as non negative fixnums
+#define hash_to_lisp(h) make_fixnum((long)((h) >> 1))
+
+prim_pairs hashtable_prims() {
+    return {
+        make_pair("make-eq-hash-table", +[](Cell* args) {
+            return make_hashtable(HashEq);
+        }),
+        make_pair("make-equal-hash-table", +[](Cell* args) {
+            return make_hashtable(HashEqual);
+        }),
+        make_pair("make-hash-table", +[](Cell* args) {
+            return make_hashtable(HashEqual);
+        }),
+        make_pair("hash-table?", +[](Cell* args) {
+            return to_lisp_bool(is_hashtable(car(args)));
+        }),
+        // (hash-table-ref table key [default]), error when key is missing
+        // and no default is given
+        make_pair("hash-table-ref", +[](Cell* args) {
+            HashEntry *e = check_table(car(args))->find(cadr(args));
+            if (e)
+                return e->val;
+            if (null(cddr(args)))
+                return_error("key not found", cadr(args));
+            return caddr(args);
+        }),
+        make_pair("hash-table-set!", +[](Cell* args) {
+            mutable_table(car(args))->put(cadr(args), caddr(args));
+            return caddr(args);
+        }),
+        make_pair("hash-table-contains?", +[](Cell* args) {
+            return to_lisp_bool(check_table(car(args))->find(cadr(args)));
+        }),
+        make_pair("hash-table-delete!", +[](Cell* args) {
+            return to_lisp_bool(mutable_table(car(args))->remove(cadr(args)));
+        }),
+        make_pair("hash-table-count", +[](Cell* args) {
+            return make_fixnum(check_table(car(args))->count);
+        }),
+        make_pair("hash-table-clear!", +[](Cell* args) {
+            mutable_table(car(args))->clear();
+            return car(args);
+        }),
+        make_pair("hash-table-keys", +[](Cell* args) {
+            Cell *acc = nil();
+            check_table(car(args))->each([&acc](HashEntry *e) {
+                acc = cons(e->key, acc);
+            });
+            return acc;
+        }),
+        make_pair("hash-table-values", +[](Cell* args) {
+            Cell *acc = nil();
+            check_table(car(args))->each([&acc](HashEntry *e) {
+                acc = cons(e->val, acc);
+            });
+            return acc;
+        }),
+        make_pair("hash-table->alist", +[](Cell* args) {
+            Cell *acc = nil();
+            check_table(car(args))->each([&acc](HashEntry *e) {
+                acc = cons(cons(e->key, e->val), acc);
+            });
+            return acc;
+        }),
+        make_pair("eq-hash", +[](Cell* args) {
+            return hash_to_lisp(eq_hash(car(args)));
+        }),
+        make_pair("equal-hash", +[](Cell* args) {
+            return hash_to_lisp(equal_hash(car(args)));
+        }),
+    };
+}
@@ -0,0 +1,83 @@
+
+#include "heap.hpp"
+#include "error.hpp"
+#include "number.hpp"
+
+// bytes given as a number with an optional k, m or g suffix
+static size_t parse_size(const char *text, size_t fallback) {
+    if (text == NULL)
+        return fallback;
+    char *end;
+    double n = strtod(text, &end);
+    if (end == text || n < 0)
+        return fallback;
+    switch (*end) {
+    case 'k': case 'K': n *= 1024; break;
+    case 'm': case 'M': n *= 1024 * 1024; break;
+    case 'g': case 'G': n *= 1024 * 1024 * 1024; break;
+    }
+    return (size_t)n;
+}
+
+HeapLimits default_heap_limits() {
+    static HeapLimits limits = [] {
+        HeapLimits l;
+        l.min = parse_size(getenv("LISP_HEAP_MIN"), HEAP_MIN_DEFAULT);
+        l.soft = parse_size(getenv("LISP_HEAP_SOFT"), HEAP_SOFT_DEFAULT);
+        l.max = parse_size(getenv("LISP_HEAP_MAX"), HEAP_MAX_DEFAULT);
+        const char *growth = getenv("LISP_GC_GROWTH");
+        l.growth = growth ? atof(growth) : GC_GROWTH_DEFAULT;
+        if (l.growth <= 1)
+            l.growth = GC_GROWTH_DEFAULT;
+        // a lower max brings the others down with it
+        l.soft = min(l.soft, l.max);
+        l.min = min(l.min, l.soft);
+        return l;
+    }();
+    return limits;
+}
+
+size_t next_gc_threshold(const HeapLimits &limits, size_t live) {
+    size_t bytes = live * CELL_BYTES;
+    size_t target = max((size_t)(bytes * limits.growth), limits.min);
+    if (target > limits.soft)
+        target = max(limits.soft, bytes + bytes / 8);
+    return min(target, limits.max) / CELL_BYTES;
+}
+
+// a limit given to set-heap-limits!, nil keeping the old one
+static size_t limit_arg(Cell *x, size_t old) {
+    if (null(x))
+        return old;
+    if (!is_integer(x) || x->as_long() <= 0)
+        error("not a heap size", x);
+    return x->as_long();
+}
+
+prim_pairs heap_prims() {
+    return {
+        make_pair("heap-limits", +[](Cell* args) {
+            HeapLimits &l = getVM()->heap_limits;
+            return cons(make_fixnum(l.min),
+                        cons(make_fixnum(l.soft), list(make_fixnum(l.max))));
+        }),
+        // (set-heap-limits! min soft max)
+        make_pair("set-heap-limits!", +[](Cell* args) {
+            VM *vm = getVM();
+            HeapLimits l = vm->heap_limits;
+            l.min = limit_arg(car(args), l.min);
+            l.soft = limit_arg(cadr(args), l.soft);
+            l.max = limit_arg(caddr(args), l.max);
+            if (l.min > l.soft || l.soft > l.max)
+                return_error("heap limits must be min <= soft <= max", args);
+            vm->heap_limits = l;
+            // a lower limit applies from the next allocation
+            vm->gc_threshold = min(next_gc_threshold(l, vm->heapCells()),
+                                   vm->gc_threshold);
+            return nil();
+        }),
+        make_pair("heap-size", +[](Cell* args) {
+            return make_fixnum(getVM()->heapCells() * CELL_BYTES);
+        }),
+    };
+}
@@ -0,0 +1,88 @@
+
+#include <pthread.h>
+#include "limits.hpp"
+#include "lisp.hpp"
+#include "error.hpp"
+#include "number.hpp"
+
+thread_local char *stack_floor = NULL;
+
+char *thread_stack_floor() {
+    pthread_attr_t attr;
+    void *addr;
+    size_t size;
+    if (pthread_getattr_np(pthread_self(), &attr) != 0)
+        return NULL;
+    pthread_attr_getstack(&attr, &addr, &size);
+    pthread_attr_destroy(&attr);
+    return (char*)addr + STACK_MARGIN;
+}
+
+Cell *limit_error(VM *vm) {
+    const char *what = vm->cancelled ? "cancelled"
+        : (char*)__builtin_frame_address(0) < stack_floor ? "too-deep"
+        : vm->fuel <= 0 ? "out-of-fuel"
+        : "out-of-cells";
+    Cell *err = make_error("apply", what, nil());
+    as_error(err)->tag = intern(what);
+    return err;
+}
+
+// Limits vm's evaluation for the scope, within the limits already in
+// force, and charges what it used to those when done.
+struct LimitScope {
+    VM *vm;
+    long fuel;
+    long outer_fuel;
+    long outer_cell_limit;
+
+    LimitScope(VM *vm, long fuel, long cells) :
+        vm(vm), outer_fuel(vm->fuel), outer_cell_limit(vm->cell_limit)
+    {
+        this->fuel = min(fuel, max(outer_fuel, 0L));
+        vm->fuel = this->fuel;
+        long room = max(outer_cell_limit - vm->cells_allocated, 0L);
+        vm->cell_limit = vm->cells_allocated + min(cells, room);
+    }
+    ~LimitScope() {
+        // calls past the limit failed, they do not count
+        long used = fuel - max(vm->fuel.load(), 0L);
+        vm->fuel = outer_fuel - used;
+        vm->cell_limit = outer_cell_limit;
+    }
+};
+
+Cell *eval_limited(Cell *exp, Environment *env, long fuel, long cells) {
+    VM *vm = getVM();
+    vm->cancelled = false;
+    LimitScope scope(vm, fuel, cells);
+    return eval_toplevel(exp, env);
+}
+
+void cancel_eval(VM *vm) {
+    vm->cancelled.store(true);
+}
+
+// a limit given to with-limits, nil for none
+static long limit_arg(Cell *x) {
+    if (null(x))
+        return NO_LIMIT;
+    if (!is_integer(x) || x->as_long() < 0)
+        error("not a limit", x);
+    return x->as_long();
+}
+
+prim_pairs limits_prims() {
+    return {
+        // (with-limits fuel cells thunk)
+        make_pair("with-limits", +[](Cell* args) {
+            if (alloc_sink)
+                return_error("limits are only set on the VM's own thread",
+                             nil());
+            long fuel = limit_arg(car(args));
+            long cells = limit_arg(cadr(args));
+            LimitScope scope(getVM(), fuel, cells);
+            return apply(caddr(args), nil());
+        }),
+    };
+}
@@ -5,13 +5,21 @@
 #include "env.hpp"
 #include "reader.hpp"
 #include "lisp.hpp"
+#include "trace.hpp"
+#include "error.hpp"
+#include "lstring.hpp"
+#include "record.hpp"
+#include "stream.hpp"
+#include "values.hpp"
+#include "future.hpp"
+#include "limits.hpp"
 
 /* #define is_symbol_eq(x, y) (x == intern(y)) */
 
-#define def_prim_symbol_test(x) bool is_## x(Cell *list) { \
-        return car(list) == intern(#x);                    \
+// the special form symbols are interned once per VM (see VM::forms)
+#define def_prim_symbol_test(x, form) bool is_## x(Cell *list) { \
+        return car(list) == getVM()->forms[form];                \
     }
-#define def_prim_symbol_test_manual(x, y) bool is_ ## x(Cell *list) { return car(list) == intern(y); }
 
 bool is_self_evaluating(Cell *x) {
     return is_number(x) || is_string(x) || is_bool(x);
@@ -21,55 +29,53 @@ bool is_variable(Cell *x) {
     return is_symbol(x);
 }
 
-def_prim_symbol_test(quote)
+def_prim_symbol_test(quote, FormQuote)
 
 Cell *eval_quote(Cell *expr, Environment *env) {
     return cadr(expr);
 }
 
-def_prim_symbol_test(if)
+def_prim_symbol_test(if, FormIf)
 
 Cell *eval_if(Cell *expr, Environment *env) {
     Cell *result = eval(cadr(expr), env);
     if (is_error(result))
         return result;
     else if (null(result)) {
-        return null(cdr(cdr(expr)))
-            ? eval(cadr(cdr(expr)), env)
-            : nil();
+        // (if test conseq alt), alt is optional
+        return null(cdr(cddr(expr)))
+            ? nil()
+            : eval(cadr(cddr(expr)), env);
     } else {
         return eval(caddr(expr), env);
     }
 }
 
-def_prim_symbol_test_manual(assignment, "set!")
+def_prim_symbol_test(assignment, FormSet)
 
 Cell *eval_assignment(Cell *exp, Environment *env) {
     Cell *var = cadr(exp);
     ensure(var, TypeSymbol);
-    Cell *val = caddr(exp);
+    Cell *val = eval(caddr(exp), env);
+    if (is_error(val))
+        return val;
 
-    return env_set_variable_value(var, val, env);
+    return env_set_variable_value(var, first_value(val), env);
 }
 
-def_prim_symbol_test(lambda) // need this test for (eval (lambda ()))
+def_prim_symbol_test(lambda, FormLambda) // need this test for (eval (lambda ()))
 /* def_prim_symbol_test(procedure); */
 
-Cell *make_procedure(Cell *param, Cell *body, Environment *env) {
-    /* Cell *param = cadr(exp); */
-    /* Cell *body = caddr(exp); */
-    Procedure *proc = new Procedure();
-    proc->param = param;
-    proc->body = body;
-    proc->env = env;
-    return make_cell(TypeProcedure, proc);
+// code is (param . body), as in the lambda expression
+Cell *make_procedure(Cell *code, Environment *env) {
+    return getVM()->makeCell(TypeProcedure, code, env);
 }
 
 Cell *eval_lambda(Cell *exp, Environment *env) {
-    return make_procedure(cadr(exp), caddr(exp), env);
+    return make_procedure(cdr(exp), env);
 }
 
-def_prim_symbol_test(define)
+def_prim_symbol_test(define, FormDefine)
 
 Cell *eval_definition(Cell *expr, Environment *env) {
     Cell *var = cadr(expr);
@@ -77,12 +83,15 @@ Cell *eval_definition(Cell *expr, Environment *env) {
         debuglog1("defining a function\n");
         Cell *fn_name = car(var);
         Cell *args = cdr(var);
-        Cell *proc = make_procedure(args, cddr(expr), env); 
+        Cell *proc = make_procedure(cons(args, cddr(expr)), env);
         env_add_var_def(fn_name, proc, env);
         debuglog1("function defined\n");
         return proc;
     } else {
-        Cell *val = caddr(expr);
+        Cell *val = eval(caddr(expr), env);
+        if (is_error(val))
+            return val;
+        val = first_value(val);
         env_add_var_def(var, val, env);
         return val;
     }
@@ -93,7 +102,44 @@ Cell *eval_definition(Cell *expr, Environment *env) {
 /*     return make_cCell(3, &name, param, body); */
 /* } */
 
-def_prim_symbol_test_manual(sequence, "begin")
+def_prim_symbol_test(try, FormTry)
+
+// (try exp handler), on error handler is called with the error tag (or
+// message) and irritant, instead of the error propagating further.
+Cell *eval_try(Cell *exp, Environment *env) {
+    Cell *result = eval_toplevel(cadr(exp), env);
+    if (!is_error(result))
+        return result;
+
+    Cell *handler = eval(caddr(exp), env);
+    if (is_error(handler))
+        return handler;
+    LispError *err = as_error(result);
+    Cell *tag = null(err->tag)
+        ? make_string(err->msg)
+        : err->tag;
+    return apply(handler, cons(tag, list(err->irritant)));
+}
+
+def_prim_symbol_test(defstruct, FormDefstruct)
+
+def_prim_symbol_test(delay, FormDelay)
+
+def_prim_symbol_test(cons_stream, FormConsStream)
+
+def_prim_symbol_test(receive, FormReceive)
+
+def_prim_symbol_test(future_form, FormFuture)
+
+def_prim_symbol_test(pcall, FormPcall)
+
+def_prim_symbol_test(sequence, FormBegin)
+
+// in the order of SpecialForm
+const char *special_forms[] = {
+    "quote", "if", "set!", "lambda", "define", "try", "defstruct", "delay",
+    "cons-stream", "receive", "future", "pcall", "begin", NULL
+};
 
 Cell *eval_sequence(Cell *exps, Environment *env) {
     Cell *out = nil();
@@ -121,34 +167,66 @@ Cell *list_of_values(Cell *expr, Environment *env) {
 }
 
 Cell *apply(Cell *func, Cell *args) {
+    trace_event(TraceApply, func, args);
     if (is_procedure(func)) {
         debuglog1("procedure - ");
         debugObj(func, ", ");
         debuglnObj(args);
-        Procedure *proc = (Procedure *)func->val;
-        //
-        Cell *arg_syms = proc->param;
-        Cell *body = proc->body;
-        Environment *env = proc->env;
-        env = env_extend_stack(arg_syms, args, env);
-        return eval_sequence(body, env);
+        // out of fuel, past the allocation quota or cancelled
+        Cell *stop = charge_call();
+        if (stop)
+            return stop;
+        Environment *env = env_extend_stack(proc_param(func), args,
+                                            proc_env(func));
+        return eval_sequence(proc_body(func), env);
     }
     else if (is_primitive(func)) {
         debuglog1("primitive - ");
         debugObj(func, ", ");
         debuglnObj(args);
-        return ((PrimLispFn)func->val)(args);
+        // primitives raise with error(), hand it back as a value
+        try {
+            return ((PrimLispFn)func->val)(args);
+        } catch (LispException &e) {
+            return e.err;
+        }
+    }
+    else if (is_record_proc(func)) {
+        try {
+            return apply_record_proc(func, args);
+        } catch (LispException &e) {
+            return e.err;
+        }
     }
     debuglog1("");
     debugObj(func, ", ");
     debuglnObj(args);
-    return_error("unsupported function %s", "\n");
+    return_error("unsupported function", func);
+}
+
+// primitives may return or keep their argument list, everything else
+// only reads it while binding
+#define args_escape(func) is_primitive(func)
+
+Cell *apply1(Cell *func, Cell *x) {
+    if (args_escape(func))
+        return apply(func, list(x));
+    Cell args = Cell(TypePair, x, nil());
+    return apply(func, &args);
+}
+
+Cell *apply2(Cell *func, Cell *x, Cell *y) {
+    if (args_escape(func) || !STACK_LISTS)
+        return apply(func, cons(x, list(y)));
+    Cell rest = Cell(TypePair, y, nil());
+    Cell args = Cell(TypePair, x, &rest);
+    return apply(func, &args);
 }
 
 Cell *eval_apply(Cell *expr, Environment *env) {
     debuglog1("");
     debugObj(expr, ", ");
-    printf("env = %p\n", (void*)env);
+    debuglograw("env = %p\n", (void*)env);
     Cell *var = car(expr);
     Cell *args = cdr(expr);
     Cell *fn = eval(var, env);
@@ -159,26 +237,30 @@ Cell *eval_apply(Cell *expr, Environment *env) {
         return nil();
     }
 
-    // some low level manipulation to make code more transparent.
-    Cell acc = Cell(TypePair, NULL);
-    Cell *ptr = &acc;
+    // the argument list is made in one piece (see VM::makeList), then
+    // filled in as the arguments are evaluated
+    size_t nargs = 0;
+    dolist_cdr(arg, args)
+        nargs++;
+    Cell *args_vals = getVM()->makeList(nargs);
+    Cell *ptr = args_vals;
     dolist_cdr(arg, args) {
         Cell *val = eval(car(arg), env);
         if (is_error(val))
             return val;
-        ptr->set_cdr(cons(val, nil()));
+        ptr->set_car(first_value(val));
         ptr = ptr->next;
     }
-    Cell *args_vals = acc.next;
     /* Cell *args_vals = list_of_values(args, env); */
     return apply(fn, args_vals);
 }
 
 Cell *eval(Cell *exp, Environment *env)
 {
+    trace_event(TraceEval, exp, env);
     debuglog1("");
     debugObj(exp, ", ");
-    printf("env = %p\n", (void*)env);
+    debuglograw("env = %p\n", (void*)env);
     if (is_self_evaluating(exp)) {
         // dont print, segment fault if exp is number
         /* debuglog("is self evaluate%s\n", (char*)exp->val); */
@@ -211,13 +293,41 @@ Cell *eval(Cell *exp, Environment *env)
         else if (is_sequence(exp)) {
             return eval_begin(exp, env);
         }
+        else if (is_try(exp)) {
+            return eval_try(exp, env);
+        }
+        else if (is_defstruct(exp)) { // (defstruct name field*)
+            return eval_defstruct(exp, env);
+        }
+        else if (is_delay(exp)) { // (delay exp)
+            return eval_delay(exp, env);
+        }
+        else if (is_cons_stream(exp)) { // (cons-stream a b)
+            return eval_cons_stream(exp, env);
+        }
+        else if (is_receive(exp)) { // (receive formals exp body ...)
+            return eval_receive(exp, env);
+        }
+        else if (is_future_form(exp)) { // (future exp)
+            return eval_future(exp, env);
+        }
+        else if (is_pcall(exp)) { // (pcall f a ...)
+            return eval_pcall(exp, env);
+        }
         /* else if (is_application(exp)) { */
         return eval_apply(exp, env);
         /* } */
     }
 
     // (proc exp*)
-    printf("unexpected lisp expression!\n");
-    exit(1);
+    return_error("unexpected lisp expression", exp);
+}
+
+Cell *eval_toplevel(Cell *exp, Environment *env) {
+    try {
+        return eval(exp, env);
+    } catch (LispException &e) {
+        return e.err;
+    }
 }
 
@@ -0,0 +1,205 @@
+
+#include "list.hpp"
+#include "lisp.hpp"
+#include "number.hpp"
+
+// Builds a list front to back. The head is a dummy pair on the C++
+// stack, the list proper starts at its cdr.
+struct ListBuilder {
+    Cell head = Cell(TypePair, NULL, nil());
+    Cell *tail = &head;
+
+    void add(Cell *x) {
+        Cell *c = cons(x, nil());
+        tail->set_cdr(c);
+        tail = c;
+    }
+    Cell *result() { return head.next; }
+};
+
+Cell *assoc_equal(Cell *key, Cell *alist) {
+    dolist_cdr(c, alist) {
+        if (is_pair(car(c)) && equal(car(car(c)), key))
+            return car(c);
+    }
+    return nil();
+}
+
+void RunBuilder::add(Cell *x) {
+    if (used == size) {
+        size = min(max(2 * size, (size_t)8), (size_t)RUN_MAX);
+        before = tail;
+        run = getVM()->makeList(size);
+        tail->set_cdr(run);
+        used = 0;
+    }
+    tail = &run[used++];
+    tail->set_car(x);
+}
+
+Cell *RunBuilder::result() {
+    if (used < size) {
+        Cell *cut = getVM()->makeList(used);
+        Cell *dst = cut;
+        for (size_t i = 0; i < used; i++, dst = dst->next)
+            dst->set_car(run[i].car());
+        before->set_cdr(cut);
+        used = size = 0;
+    }
+    return head.next;
+}
+
+static Cell *member_if(Cell *x, Cell *list, bool use_equal) {
+    dolist_cdr(c, list) {
+        if (use_equal ? equal(car(c), x) : car(c) == x)
+            return c;
+    }
+    return nil();
+}
+
+// (map f l1 l2 ...), up to the shortest list; collect is false for for-each
+static Cell *map_lists(Cell *fn, Cell *lists, bool collect) {
+    ListBuilder out;
+    if (null(cdr(lists))) {
+        dolist_cdr(c, car(lists)) {
+            Cell *r = check_result(apply1(fn, car(c)));
+            if (collect)
+                out.add(r);
+        }
+        return out.result();
+    }
+
+    vector<Cell*> rest;
+    dolist_cdr(c, lists) {
+        rest.push_back(car(c));
+    }
+    for (;;) {
+        ListBuilder args;
+        for (Cell *&l : rest) {
+            if (null(l))
+                return out.result();
+            args.add(car(l));
+            l = cdr(l);
+        }
+        Cell *r = check_result(apply(fn, args.result()));
+        if (collect)
+            out.add(r);
+    }
+}
+
+// Bottom up merge sort. An element of the right run is taken first only
+// when it is strictly less, which keeps the sort stable. Returns an
+// error from less, or NULL.
+static Cell *merge_sort(vector<Cell*> &v, Cell *less) {
+    vector<Cell*> tmp(v.size());
+    for (size_t width = 1; width < v.size(); width *= 2) {
+        for (size_t lo = 0; lo < v.size(); lo += 2 * width) {
+            size_t mid = min(lo + width, v.size());
+            size_t hi = min(lo + 2 * width, v.size());
+            size_t i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) {
+                Cell *r = apply2(less, v[j], v[i]);
+                if (is_error(r))
+                    return r;
+                tmp[k++] = null(r) ? v[i++] : v[j++];
+            }
+            while (i < mid)
+                tmp[k++] = v[i++];
+            while (j < hi)
+                tmp[k++] = v[j++];
+        }
+        v.swap(tmp);
+    }
+    return NULL;
+}
+
+prim_pairs list_prims() {
+    return {
+        // (append l1 ... ln), every list but the last is copied
+        make_pair("append", +[](Cell* args) {
+            if (null(args))
+                return nil();
+            ListBuilder out;
+            for (; !null(cdr(args)); args = cdr(args)) {
+                dolist_cdr(c, car(args)) {
+                    out.add(car(c));
+                }
+            }
+            out.tail->set_cdr(car(args));
+            return out.result();
+        }),
+        make_pair("reverse", +[](Cell* args) {
+            return reverse(car(args));
+        }),
+        make_pair("length", +[](Cell* args) {
+            return make_fixnum(length(car(args)));
+        }),
+        make_pair("map", +[](Cell* args) {
+            return map_lists(car(args), cdr(args), true);
+        }),
+        make_pair("for-each", +[](Cell* args) {
+            Cell *r = map_lists(car(args), cdr(args), false);
+            return is_error(r) ? r : nil();
+        }),
+        make_pair("filter", +[](Cell* args) {
+            ListBuilder out;
+            dolist_cdr(c, cadr(args)) {
+                if (!null(check_result(apply1(car(args), car(c)))))
+                    out.add(car(c));
+            }
+            return out.result();
+        }),
+        // (fold kons knil list), (kons elt acc) from the left
+        make_pair("fold", +[](Cell* args) {
+            Cell *acc = cadr(args);
+            dolist_cdr(c, caddr(args)) {
+                acc = check_result(apply2(car(args), car(c), acc));
+            }
+            return acc;
+        }),
+        // (fold-right kons knil list), (kons elt acc) from the right
+        make_pair("fold-right", +[](Cell* args) {
+            vector<Cell*> elts;
+            dolist_cdr(c, caddr(args)) {
+                elts.push_back(car(c));
+            }
+            Cell *acc = cadr(args);
+            for (size_t i = elts.size(); i-- > 0;)
+                acc = check_result(apply2(car(args), elts[i], acc));
+            return acc;
+        }),
+        make_pair("assoc", +[](Cell* args) {
+            return assoc_equal(car(args), cadr(args));
+        }),
+        make_pair("assq", +[](Cell* args) {
+            dolist_cdr(c, cadr(args)) {
+                if (is_pair(car(c)) && car(car(c)) == car(args))
+                    return car(c);
+            }
+            return nil();
+        }),
+        make_pair("member", +[](Cell* args) {
+            return member_if(car(args), cadr(args), true);
+        }),
+        make_pair("memq", +[](Cell* args) {
+            return member_if(car(args), cadr(args), false);
+        }),
+        // (sort list less?), stable, returns a new list
+        make_pair("sort", +[](Cell* args) {
+            vector<Cell*> v;
+            dolist_cdr(c, car(args)) {
+                v.push_back(car(c));
+            }
+            Cell *err = merge_sort(v, cadr(args));
+            if (err)
+                return err;
+            Cell *out = getVM()->makeList(v.size());
+            Cell *dst = out;
+            for (Cell *x : v) {
+                dst->set_car(x);
+                dst = dst->next;
+            }
+            return out;
+        }),
+    };
+}
@@ -0,0 +1,166 @@
+
+#include "lstring.hpp"
+#include "printer.hpp"
+#include "number.hpp"
+
+// header and chars in one block
+static LispString *alloc_lstring(size_t len) {
+    LispString *str = (LispString*)malloc(sizeof(LispString) + len + 1);
+    if (str == NULL)
+        error("cannot allocate string", nil());
+    str->len = len;
+    str->chars = (char*)(str + 1);
+    str->chars[len] = '\0';
+    str->base = NULL;
+    return str;
+}
+
+Cell *make_string(const char *chars, size_t len) {
+    LispString *str = alloc_lstring(len);
+    memcpy(str->chars, chars, len);
+    return make_cell(TypeString, str);
+}
+
+Cell *make_string(const char *str) {
+    return make_string(str, strlen(str));
+}
+
+Cell *make_substring(Cell *str, size_t start, size_t end) {
+    LispString *from = as_lstring(str);
+    if (end - start < STRING_VIEW_MIN)
+        return make_string(from->chars + start, end - start);
+
+    // views always point at an owned string, never at another view
+    LispString *view = (LispString*)malloc(sizeof(LispString));
+    if (view == NULL)
+        error("cannot allocate string", nil());
+    view->len = end - start;
+    view->chars = from->chars + start;
+    view->base = from->is_view() ? from->base : str;
+    return make_cell(TypeString, view);
+}
+
+bool string_equal(Cell *x, Cell *y) {
+    return string_len(x) == string_len(y)
+        && memcmp(string_chars(x), string_chars(y), string_len(x)) == 0;
+}
+
+string lstring_copy(Cell *str) {
+    return string(string_chars(str), string_len(str));
+}
+
+void free_lstring(LispString *str) {
+    free(str);
+}
+
+//
+
+static Cell *check_string(Cell *x) {
+    if (!is_string(x))
+        error("not a string", x);
+    return x;
+}
+
+static string *check_builder(Cell *x) {
+    if (!is_string_builder(x))
+        error("not a string builder", x);
+    return as_string_builder(x);
+}
+
+static size_t check_bound(Cell *x, size_t max) {
+    if (!is_integer(x) || x->as_long() < 0 || (size_t)x->as_long() > max)
+        error("index out of range", x);
+    return x->as_long();
+}
+
+// strings and symbols add their chars, anything else its printed form
+static void builder_add(string &buf, Cell *x) {
+    static thread_local Printer printer;
+    if (is_string(x))
+        buf.append(string_chars(x), string_len(x));
+    else if (is_symbol(x) && !null(x))
+        buf.append(x->as_char_str());
+    else {
+        printer.clear();
+        buf.append(printer.print(x).str());
+    }
+}
+
+prim_pairs string_prims() {
+    return {
+        make_pair("string?", +[](Cell* args) {
+            return to_lisp_bool(is_string(car(args)));
+        }),
+        make_pair("string-length", +[](Cell* args) {
+            return make_fixnum(string_len(check_string(car(args))));
+        }),
+        // (substring str start [end]), shares the chars of str
+        make_pair("substring", +[](Cell* args) {
+            Cell *str = check_string(car(args));
+            size_t len = string_len(str);
+            size_t end = null(cddr(args)) ? len : check_bound(caddr(args), len);
+            size_t start = check_bound(cadr(args), end);
+            return make_substring(str, start, end);
+        }),
+        // one allocation for the result, however many parts
+        make_pair("string-append", +[](Cell* args) {
+            size_t len = 0;
+            dolist_cdr(c, args) {
+                len += string_len(check_string(car(c)));
+            }
+            string buf;
+            buf.reserve(len);
+            dolist_cdr(c, args) {
+                buf.append(string_chars(car(c)), string_len(car(c)));
+            }
+            return make_string(buf.data(), buf.size());
+        }),
+        make_pair("string=?", +[](Cell* args) {
+            return to_lisp_bool(string_equal(check_string(car(args)),
+                                             check_string(cadr(args))));
+        }),
+        // an owned copy, drops the reference a view holds on its base
+        make_pair("string-copy", +[](Cell* args) {
+            Cell *str = check_string(car(args));
+            return make_string(string_chars(str), string_len(str));
+        }),
+        make_pair("string->symbol", +[](Cell* args) {
+            return intern(lstring_copy(check_string(car(args))).c_str());
+        }),
+        make_pair("symbol->string", +[](Cell* args) {
+            if (!is_symbol(car(args)))
+                return_error("not a symbol", car(args));
+            return make_string(null(car(args)) ? "nil"
+                               : car(args)->as_char_str());
+        }),
+        make_pair("number->string", +[](Cell* args) {
+            if (!is_number(car(args)))
+                return_error("not a number", car(args));
+            string buf;
+            builder_add(buf, car(args));
+            return make_string(buf.data(), buf.size());
+        }),
+        make_pair("make-string-builder", +[](Cell* args) {
+            return make_cell(TypeStringBuilder, new string());
+        }),
+        make_pair("string-builder?", +[](Cell* args) {
+            return to_lisp_bool(is_string_builder(car(args)));
+        }),
+        // (string-builder-append! sb x ...)
+        make_pair("string-builder-append!", +[](Cell* args) {
+            string *buf = check_builder(car(args));
+            check_mutable(car(args));
+            dolist_cdr(c, cdr(args)) {
+                builder_add(*buf, car(c));
+            }
+            return car(args);
+        }),
+        make_pair("string-builder-length", +[](Cell* args) {
+            return make_fixnum(check_builder(car(args))->size());
+        }),
+        make_pair("string-builder->string", +[](Cell* args) {
+            string *buf = check_builder(car(args));
+            return make_string(buf->data(), buf->size());
+        }),
+    };
+}
@@ -0,0 +1,327 @@
+
+#include <limits.h>
+#include "number.hpp"
+#include "values.hpp"
+
+Cell *make_fixnum(long n) {
+    return make_cell(TypeInt, (void*)n);
+}
+
+Cell *make_flonum(double d) {
+    void* x = *reinterpret_cast<void**>(&d);
+    return make_cell(TypeFloat, x);
+}
+
+Cell *make_integer(const BigInt &n) {
+    if (n.fits_long())
+        return make_fixnum(n.to_long());
+    return make_cell(TypeBigNum, new BigInt(n));
+}
+
+Cell *make_rational(BigInt num, BigInt den) {
+    if (den.is_zero())
+        error("division by zero", nil());
+    if (den.neg) {
+        num = -num;
+        den = -den;
+    }
+    BigInt g = BigInt::gcd(num, den);
+    if (!(g == BigInt(1))) {
+        BigInt rem;
+        BigInt::divmod(num, g, num, rem);
+        BigInt::divmod(den, g, den, rem);
+    }
+    if (den == BigInt(1))
+        return make_integer(num);
+    Ratio *r = new Ratio();
+    r->num = num;
+    r->den = den;
+    return make_cell(TypeRatio, r);
+}
+
+//
+
+enum NumRank { RankFixnum, RankBignum, RankRatio, RankFloat };
+
+static NumRank num_rank(Cell *x) {
+    switch (x->type) {
+    case TypeInt: return RankFixnum;
+    case TypeBigNum: return RankBignum;
+    case TypeRatio: return RankRatio;
+    case TypeFloat: return RankFloat;
+    default:
+        error("not a number", x);
+    }
+}
+
+static BigInt to_bigint(Cell *x) {
+    return is_integer(x) ? BigInt(x->as_long()) : *as_bignum(x);
+}
+
+static Ratio to_ratio(Cell *x) {
+    if (is_ratio(x))
+        return *as_ratio(x);
+    Ratio r;
+    r.num = to_bigint(x);
+    r.den = BigInt(1);
+    return r;
+}
+
+static BigInt to_exact_integer(Cell *x) {
+    if (!is_exact_integer(x))
+        error("not an integer", x);
+    return to_bigint(x);
+}
+
+double num_to_double(Cell *x) {
+    switch (num_rank(x)) {
+    case RankFixnum: return (double)x->as_long();
+    case RankBignum: return as_bignum(x)->to_double();
+    case RankRatio:
+        return as_ratio(x)->num.to_double() / as_ratio(x)->den.to_double();
+    default: return x->as_double();
+    }
+}
+
+// rank both operands are promoted to
+#define common_rank(a, b) max(num_rank(a), num_rank(b))
+
+Cell *num_add(Cell *a, Cell *b) {
+    long r;
+    if (both_fixnum(a, b)
+        && !__builtin_add_overflow(a->as_long(), b->as_long(), &r))
+        return make_fixnum(r);
+
+    switch (common_rank(a, b)) {
+    case RankFloat:
+        return make_flonum(num_to_double(a) + num_to_double(b));
+    case RankRatio: {
+        Ratio x = to_ratio(a), y = to_ratio(b);
+        return make_rational(x.num * y.den + y.num * x.den, x.den * y.den);
+    }
+    default:
+        return make_integer(to_bigint(a) + to_bigint(b));
+    }
+}
+
+Cell *num_sub(Cell *a, Cell *b) {
+    long r;
+    if (both_fixnum(a, b)
+        && !__builtin_sub_overflow(a->as_long(), b->as_long(), &r))
+        return make_fixnum(r);
+
+    switch (common_rank(a, b)) {
+    case RankFloat:
+        return make_flonum(num_to_double(a) - num_to_double(b));
+    case RankRatio: {
+        Ratio x = to_ratio(a), y = to_ratio(b);
+        return make_rational(x.num * y.den - y.num * x.den, x.den * y.den);
+    }
+    default:
+        return make_integer(to_bigint(a) - to_bigint(b));
+    }
+}
+
+Cell *num_mul(Cell *a, Cell *b) {
+    long r;
+    if (both_fixnum(a, b)
+        && !__builtin_mul_overflow(a->as_long(), b->as_long(), &r))
+        return make_fixnum(r);
+
+    switch (common_rank(a, b)) {
+    case RankFloat:
+        return make_flonum(num_to_double(a) * num_to_double(b));
+    case RankRatio: {
+        Ratio x = to_ratio(a), y = to_ratio(b);
+        return make_rational(x.num * y.num, x.den * y.den);
+    }
+    default:
+        return make_integer(to_bigint(a) * to_bigint(b));
+    }
+}
+
+Cell *num_div(Cell *a, Cell *b) {
+    if (both_fixnum(a, b)) {
+        long x = a->as_long(), y = b->as_long();
+        if (y != 0 && !(x == LONG_MIN && y == -1) && x % y == 0)
+            return make_fixnum(x / y);
+    }
+
+    if (common_rank(a, b) == RankFloat)
+        return make_flonum(num_to_double(a) / num_to_double(b));
+    Ratio x = to_ratio(a), y = to_ratio(b);
+    return make_rational(x.num * y.den, x.den * y.num);
+}
+
+int num_compare(Cell *a, Cell *b) {
+    if (both_fixnum(a, b)) {
+        long x = a->as_long(), y = b->as_long();
+        return (x > y) - (x < y);
+    }
+
+    switch (common_rank(a, b)) {
+    case RankFloat: {
+        double x = num_to_double(a), y = num_to_double(b);
+        if (x < y) return -1;
+        if (x > y) return 1;
+        return x == y ? 0 : 2;
+    }
+    case RankRatio: {
+        Ratio x = to_ratio(a), y = to_ratio(b);
+        return BigInt::compare(x.num * y.den, y.num * x.den);
+    }
+    default:
+        return BigInt::compare(to_bigint(a), to_bigint(b));
+    }
+}
+
+bool num_equal(Cell *a, Cell *b) {
+    switch (a->type) {
+    case TypeInt:
+        return a->as_long() == b->as_long();
+    case TypeFloat:
+        return a->as_double() == b->as_double();
+    case TypeBigNum:
+        return *as_bignum(a) == *as_bignum(b);
+    case TypeRatio:
+        return as_ratio(a)->num == as_ratio(b)->num
+            && as_ratio(a)->den == as_ratio(b)->den;
+    default:
+        return false;
+    }
+}
+
+size_t num_hash(Cell *x) {
+    switch (x->type) {
+    case TypeInt:
+        return (size_t)x->as_long();
+    case TypeFloat: {
+        // -0.0 == 0.0, so both hash as 0
+        double d = x->as_double();
+        return d == 0 ? 0 : (size_t)x->as_long();
+    }
+    case TypeBigNum:
+        return as_bignum(x)->hash();
+    case TypeRatio:
+        return as_ratio(x)->num.hash() * 31 + as_ratio(x)->den.hash();
+    default:
+        return 0;
+    }
+}
+
+//
+
+typedef Cell *(*NumOp)(Cell*, Cell*);
+
+// generic path of the variadic operators, from the first argument that
+// left the fixnum fast path
+static Cell *num_fold(NumOp op, Cell *acc, Cell *rest) {
+    dolist_cdr(c, rest) {
+        acc = op(acc, car(c));
+    }
+    return acc;
+}
+
+// (< a b c ...) and friends, true when every adjacent pair passes test
+static Cell *num_chain(Cell *args, bool (*test)(int)) {
+    dolist_cdr(c, args) {
+        Cell *a = car(c);
+        num_rank(a);
+        if (null(cdr(c)))
+            break;
+        int ord = num_compare(a, cadr(c));
+        if (ord == 2 || !test(ord))
+            return nil();
+    }
+    return lisp_true;
+}
+
+// quotient and remainder, truncating towards zero
+static void num_truncate(Cell *a, Cell *b, Cell **q, Cell **r) {
+    if (both_fixnum(a, b)) {
+        long x = a->as_long(), y = b->as_long();
+        if (y != 0 && !(x == LONG_MIN && y == -1)) {
+            if (q) *q = make_fixnum(x / y);
+            if (r) *r = make_fixnum(x % y);
+            return;
+        }
+    }
+
+    BigInt x = to_exact_integer(a), y = to_exact_integer(b), bq, br;
+    if (y.is_zero())
+        error("division by zero", b);
+    BigInt::divmod(x, y, bq, br);
+    if (q) *q = make_integer(bq);
+    if (r) *r = make_integer(br);
+}
+
+prim_pairs number_prims() {
+    return {
+        make_pair("+", +[](Cell* args) {
+            long acc = 0, r;
+            dolist_cdr(c, args) {
+                Cell *x = car(c);
+                if (!is_integer(x)
+                    || __builtin_add_overflow(acc, x->as_long(), &r))
+                    return num_fold(num_add, make_fixnum(acc), c);
+                acc = r;
+            }
+            return make_fixnum(acc);
+        }),
+        make_pair("*", +[](Cell* args) {
+            long acc = 1, r;
+            dolist_cdr(c, args) {
+                Cell *x = car(c);
+                if (!is_integer(x)
+                    || __builtin_mul_overflow(acc, x->as_long(), &r))
+                    return num_fold(num_mul, make_fixnum(acc), c);
+                acc = r;
+            }
+            return make_fixnum(acc);
+        }),
+        make_pair("-", +[](Cell* args) {
+            if (null(cdr(args)))
+                return num_sub(make_fixnum(0), car(args));
+            return num_fold(num_sub, car(args), cdr(args));
+        }),
+        make_pair("/", +[](Cell* args) {
+            if (null(cdr(args)))
+                return num_div(make_fixnum(1), car(args));
+            return num_fold(num_div, car(args), cdr(args));
+        }),
+        make_pair("=", +[](Cell* args) {
+            return num_chain(args, [](int ord) { return ord == 0; });
+        }),
+        make_pair("<", +[](Cell* args) {
+            return num_chain(args, [](int ord) { return ord < 0; });
+        }),
+        make_pair(">", +[](Cell* args) {
+            return num_chain(args, [](int ord) { return ord > 0; });
+        }),
+        make_pair("<=", +[](Cell* args) {
+            return num_chain(args, [](int ord) { return ord <= 0; });
+        }),
+        make_pair(">=", +[](Cell* args) {
+            return num_chain(args, [](int ord) { return ord >= 0; });
+        }),
+        make_pair("quotient", +[](Cell* args) {
+            Cell *q;
+            num_truncate(car(args), cadr(args), &q, NULL);
+            return q;
+        }),
+        make_pair("remainder", +[](Cell* args) {
+            Cell *r;
+            num_truncate(car(args), cadr(args), NULL, &r);
+            return r;
+        }),
+        // (truncate/ a b), the quotient and remainder as two values
+        make_pair("truncate/", +[](Cell* args) {
+            Cell *q, *r;
+            num_truncate(car(args), cadr(args), &q, &r);
+            return values2(q, r);
+        }),
+        make_pair("number?", +[](Cell* args) {
+            return to_lisp_bool(is_number(car(args)));
+        }),
+    };
+}
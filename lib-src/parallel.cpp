@@ -0,0 +1,125 @@
+
+#include <math.h>
+#include <atomic>
+#include "pool.hpp"
+#include "lisp.hpp"
+#include "number.hpp"
+#include "vector.hpp"
+#include "error.hpp"
+#include "values.hpp"
+
+// below this many elements a sort stays on one thread
+#define PARALLEL_SORT_CUTOFF (1 << 14)
+// a Lisp comparator costs far more per call, so it splits sooner
+#define PARALLEL_SORT_CUTOFF_LISP (1 << 10)
+
+// `<` and `>` compare unboxed; NaN sorts last so the order stays strict
+// weak either way
+static int native_order(Cell *less) {
+    if (!is_primitive(less))
+        return 0;
+    if (strcmp(prim_name(less), "<") == 0)
+        return 1;
+    if (strcmp(prim_name(less), ">") == 0)
+        return -1;
+    return 0;
+}
+
+static bool native_less(int64_t x, int64_t y, int order) {
+    return order > 0 ? x < y : x > y;
+}
+
+static bool native_less(double x, double y, int order) {
+    if (isnan(y))
+        return !isnan(x);
+    return order > 0 ? x < y : x > y;
+}
+
+static Cell *box(double x) { return make_flonum(x); }
+static Cell *box(int64_t x) { return make_fixnum(x); }
+
+// Calls a Lisp comparator. After the first error every comparison is
+// false, so the sort still finishes with a permutation of the data.
+template<typename T>
+struct LispLess {
+    Cell *fn;
+    std::atomic<Cell*> *failure;
+
+    bool operator()(T x, T y) {
+        if (failure->load(std::memory_order_relaxed))
+            return false;
+        Cell *r = apply2(fn, box(x), box(y));
+        if (is_error(r)) {
+            Cell *none = NULL;
+            failure->compare_exchange_strong(none, r);
+            return false;
+        }
+        return !null(r);
+    }
+};
+
+template<typename T>
+static Cell *sort_vector(T *data, size_t n, Cell *less) {
+    int order = native_order(less);
+    if (order != 0) {
+        parallel_sort(data, n, [order](T x, T y) {
+            return native_less(x, y, order);
+        }, PARALLEL_SORT_CUTOFF);
+        return NULL;
+    }
+    std::atomic<Cell*> failure(NULL);
+    parallel_sort(data, n, LispLess<T>{less, &failure},
+                  PARALLEL_SORT_CUTOFF_LISP);
+    return failure.load();
+}
+
+static void map_into(Cell *out, Cell *fn, Cell *in) {
+    NumVector *a = as_numvector(in), *r = as_numvector(out);
+    size_t tasks = min(a->len, pool_size() * 4);
+    parallel_run(tasks, [&](size_t t) {
+        size_t end = a->len * (t + 1) / tasks;
+        for (size_t i = a->len * t / tasks; i < end; i++) {
+            Cell *x = first_value(
+                apply1(fn, is_f64vector(in) ? box(a->f64()[i])
+                                            : box(a->s64()[i])));
+            if (is_error(x))
+                throw_error(x);
+            if (is_f64vector(out)) {
+                r->f64()[i] = num_to_double(x);
+            } else {
+                if (!is_integer(x))
+                    error("not a fixnum", x);
+                r->s64()[i] = x->as_long();
+            }
+        }
+    });
+}
+
+prim_pairs parallel_prims() {
+    return {
+        // (parallel-sort! vec less?), sorts an f64/s64 vector in place
+        make_pair("parallel-sort!", +[](Cell* args) {
+            Cell *vec = car(args);
+            if (!is_numvector(vec))
+                return_error("not a numeric vector", vec);
+            check_mutable(vec);
+            NumVector *v = as_numvector(vec);
+            Cell *err = is_f64vector(vec)
+                ? sort_vector(v->f64(), v->len, cadr(args))
+                : sort_vector(v->s64(), v->len, cadr(args));
+            return err ? err : vec;
+        }),
+        // (parallel-map f vec), a new vector of the same type
+        make_pair("parallel-map", +[](Cell* args) {
+            Cell *vec = cadr(args);
+            if (!is_numvector(vec))
+                return_error("not a numeric vector", vec);
+            Cell *out = make_numvector(vec->type, as_numvector(vec)->len);
+            map_into(out, car(args), vec);
+            return out;
+        }),
+        make_pair("parallel-workers", +[](Cell* args) {
+            return make_fixnum(pool_size());
+        }),
+    };
+}
@@ -0,0 +1,206 @@
+
+#include <thread>
+#include <deque>
+#include <atomic>
+#include <condition_variable>
+#include "pool.hpp"
+#include "error.hpp"
+
+// The tasks of one thread. Its owner pushes and pops at the back, so
+// fork-join code works depth first; thieves take from the front, the
+// oldest and usually largest pieces of work.
+struct TaskDeque {
+    mutex lock;
+    deque<function<void()>> tasks;
+
+    bool pop_back(function<void()> &out) {
+        lock_guard<mutex> g(lock);
+        if (tasks.empty())
+            return false;
+        out = std::move(tasks.back());
+        tasks.pop_back();
+        return true;
+    }
+    bool pop_front(function<void()> &out) {
+        lock_guard<mutex> g(lock);
+        if (tasks.empty())
+            return false;
+        out = std::move(tasks.front());
+        tasks.pop_front();
+        return true;
+    }
+};
+
+struct Scheduler {
+    vector<thread> threads;
+    vector<TaskDeque*> deques;      // deque of worker i
+    TaskDeque injected;             // spawned by threads outside the pool
+    atomic<size_t> queued;          // tasks in all the deques
+    mutex sleep_lock;
+    condition_variable wake;
+};
+
+static Scheduler *sched = NULL;
+// the deque of the calling worker, NULL off the pool
+static thread_local TaskDeque *own_deque = NULL;
+static thread_local size_t steal_seed = 0;
+
+// Own tasks newest first, then outside ones, then the oldest task of
+// another worker.
+static bool find_task(Scheduler *s, function<void()> &out) {
+    if (s->queued.load() == 0)
+        return false;
+    bool found = (own_deque && own_deque->pop_back(out))
+        || s->injected.pop_front(out);
+    size_t n = s->deques.size();
+    for (size_t i = 0; !found && i < n; i++) {
+        TaskDeque *victim = s->deques[(steal_seed + i) % n];
+        found = victim != own_deque && victim->pop_front(out);
+    }
+    steal_seed++;
+    if (found)
+        s->queued--;
+    return found;
+}
+
+static void worker_loop(Scheduler *s, size_t id) {
+    own_deque = s->deques[id];
+    steal_seed = id;
+    function<void()> task;
+    for (;;) {
+        if (find_task(s, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        unique_lock<mutex> lk(s->sleep_lock);
+        s->wake.wait(lk, [s] { return s->queued.load() > 0; });
+    }
+}
+
+static Scheduler *get_scheduler() {
+    static once_flag started;
+    call_once(started, [] {
+        const char *env = getenv("LISP_WORKERS");
+        long n = env ? atol(env) : (long)thread::hardware_concurrency() - 1;
+        Scheduler *s = new Scheduler();
+        s->queued = 0;
+        for (long i = 0; i < n; i++)
+            s->deques.push_back(new TaskDeque());
+        for (long i = 0; i < n; i++)
+            s->threads.push_back(thread(worker_loop, s, i));
+        sched = s;
+    });
+    return sched;
+}
+
+size_t pool_size() {
+    return get_scheduler()->threads.size() + 1;
+}
+
+void spawn(function<void()> task) {
+    Scheduler *s = get_scheduler();
+    if (s->threads.empty()) {
+        task();
+        return;
+    }
+    TaskDeque *d = own_deque ? own_deque : &s->injected;
+    {
+        lock_guard<mutex> g(d->lock);
+        d->tasks.push_back(std::move(task));
+    }
+    s->queued++;
+    // taking the lock orders this against a worker about to sleep
+    { lock_guard<mutex> g(s->sleep_lock); }
+    s->wake.notify_one();
+}
+
+static void run_until(const function<bool()> &done, VM *owner) {
+    Scheduler *s = get_scheduler();
+    function<void()> task;
+    while (!done()) {
+        if (find_task(s, task)) {
+            task();
+            task = nullptr;
+        } else {
+            // the tasks allocating are waited for, collect for them
+            if (owner && owner->gc_wanted.load() && !owner->collecting)
+                owner->gc();
+            this_thread::yield();
+        }
+    }
+}
+
+void help_until(const function<bool()> &done) {
+    // a task waiting is at a safe point, its VM may collect meanwhile
+    if (alloc_sink)
+        getVM()->task_pause([&done] { run_until(done, NULL); }, false);
+    else
+        run_until(done, getVM());
+}
+
+void parallel_run(size_t n, const function<void(size_t)> &task) {
+    if (n <= 1 || get_scheduler()->threads.empty()) {
+        for (size_t i = 0; i < n; i++)
+            task(i);
+        return;
+    }
+
+    VM *vm = getVM();
+    // the collector's own batches are not tasks of the VM, which is
+    // stopping them
+    bool tasks = !vm->collecting;
+    vector<List> sinks(n);
+    atomic<size_t> left(n);
+    mutex failure_lock;
+    Cell *failure = NULL;
+    if (tasks) {
+        vm->in_flight++;
+        for (List &sink : sinks)
+            vm->add_sink(&sink);
+    }
+
+    auto run = [&](size_t i) {
+        VMScope scope(vm);
+        List *outer = alloc_sink;
+        alloc_sink = &sinks[i];
+        if (tasks)
+            vm->task_enter(NULL);
+        Cell *err = NULL;
+        try {
+            task(i);
+        } catch (LispException &e) {
+            err = e.err;
+        } catch (std::exception &e) {
+            err = make_error(__func__, "parallel task failed", nil());
+        }
+        if (tasks)
+            vm->task_leave(NULL);
+        alloc_sink = outer;
+        if (err) {
+            lock_guard<mutex> g(failure_lock);
+            if (!failure)
+                failure = err;
+        }
+        left--;
+    };
+    for (size_t i = 1; i < n; i++)
+        spawn([&run, i] { run(i); });
+    run(0);
+    help_until([&left] { return left.load() == 0; });
+
+    // the cells go where the caller allocates
+    List *dst = alloc_sink ? alloc_sink : &vm->heap;
+    for (List &sink : sinks) {
+        if (tasks)
+            vm->drop_sink(&sink);
+        dst->insert(dst->end(), sink.begin(), sink.end());
+        if (dst == &vm->heap)
+            vm->cells_allocated += sink.size();
+    }
+    if (tasks)
+        vm->in_flight--;
+
+    if (failure)
+        throw_error(failure);
+}
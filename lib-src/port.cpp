@@ -0,0 +1,287 @@
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "port.hpp"
+#include "reader.hpp"
+#include "printer.hpp"
+#include "lstring.hpp"
+#include "number.hpp"
+#include "green.hpp"
+
+Port::Port(int fd, bool input, bool close_fd, const string &name) :
+    fd(fd), input(input), close_fd(close_fd), mapped(false), closed(false),
+    buf(NULL), pos(0), end(0), cap(0), name(name)
+{
+    struct stat st;
+    if (input && fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+        && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            buf = (char*)map;
+            mapped = true;
+            end = cap = st.st_size;
+            return;
+        }
+    }
+    cap = PORT_BUFFER_SIZE;
+    buf = (char*)malloc(cap);
+    if (buf == NULL)
+        error("cannot allocate port buffer", nil());
+}
+
+Port::~Port() {
+    close();
+    if (mapped)
+        munmap(buf, cap);
+    else
+        free(buf);
+}
+
+bool Port::fill() {
+    if (closed || mapped || fd < 0 || !input)
+        return false;
+    // other green threads run while this one waits for data
+    green_wait_fd(fd, POLLIN);
+    lock_guard<recursive_mutex> g(lock);
+    ssize_t n;
+    do {
+        n = ::read(fd, buf, cap);
+    } while (n < 0 && errno == EINTR);
+    pos = 0;
+    end = n > 0 ? n : 0;
+    return end > 0;
+}
+
+size_t Port::read(string &out, size_t n) {
+    lock_guard<recursive_mutex> g(lock);
+    size_t got = 0;
+    while (got < n && (pos < end || fill())) {
+        size_t len = min(n - got, end - pos);
+        out.append(buf + pos, len);
+        pos += len;
+        got += len;
+    }
+    return got;
+}
+
+bool Port::read_line(string &out) {
+    lock_guard<recursive_mutex> g(lock);
+    bool any = false;
+    while (pos < end || fill()) {
+        any = true;
+        char *nl = (char*)memchr(buf + pos, '\n', end - pos);
+        if (nl) {
+            out.append(buf + pos, nl - (buf + pos));
+            pos = nl - buf + 1;
+            return true;
+        }
+        out.append(buf + pos, end - pos);
+        pos = end;
+    }
+    return any;
+}
+
+void Port::write(const char *data, size_t len) {
+    lock_guard<recursive_mutex> g(lock);
+    if (end + len > cap)
+        drain();
+    if (len >= cap) {
+        // too big to be worth copying
+        for (size_t done = 0; done < len;) {
+            ssize_t n = ::write(fd, data + done, len - done);
+            if (n < 0 && errno != EINTR)
+                error("write failed", make_string(name.c_str()));
+            done += n > 0 ? n : 0;
+        }
+        return;
+    }
+    memcpy(buf + end, data, len);
+    end += len;
+}
+
+void Port::flush() {
+    lock_guard<recursive_mutex> g(lock);
+    drain();
+}
+
+void Port::drain() {
+    if (input || fd < 0)
+        return;
+    size_t done = 0;
+    while (done < end) {
+        ssize_t n = ::write(fd, buf + done, end - done);
+        if (n < 0 && errno != EINTR)
+            break;
+        done += n > 0 ? n : 0;
+    }
+    end = 0;
+}
+
+void Port::close() {
+    lock_guard<recursive_mutex> g(lock);
+    if (closed)
+        return;
+    drain();
+    if (close_fd)
+        ::close(fd);
+    closed = true;
+    pos = end = 0;
+}
+
+Cell *eof_object() {
+    static Cell *eof = permanent(Cell(TypeEof));
+    return eof;
+}
+
+Port *new_string_port(const char *chars, size_t len) {
+    Port *port = new Port(-1, true, false, "string");
+    if (len > port->cap) {
+        char *buf = (char*)realloc(port->buf, len);
+        if (buf == NULL) {
+            delete port;
+            error("cannot allocate port buffer", nil());
+        }
+        port->buf = buf;
+        port->cap = len;
+    }
+    memcpy(port->buf, chars, len);
+    port->end = len;
+    return port;
+}
+
+// the standard streams are shared by every VM and never collected
+#define std_port(fd, input, name) ({                                    \
+            static Cell *port = permanent(                              \
+                Cell(TypePort, new Port(fd, input, false, name)));      \
+            port;                                                       \
+        })
+
+Cell *stdin_port() { return std_port(0, true, "stdin"); }
+Cell *stdout_port() { return std_port(1, false, "stdout"); }
+Cell *stderr_port() { return std_port(2, false, "stderr"); }
+
+static Port *port_arg(Cell *args, Cell *(*fallback)(), bool input) {
+    Cell *p = null(args) ? fallback() : car(args);
+    if (!is_port(p) || as_port(p)->input != input)
+        error(input ? "not an input port" : "not an output port", p);
+    if (as_port(p)->closed)
+        error("port is closed", p);
+    return as_port(p);
+}
+
+#define input_port_arg(args) port_arg(args, stdin_port, true)
+#define output_port_arg(args) port_arg(args, stdout_port, false)
+
+static Cell *open_file(Cell *path, int flags, bool input) {
+    if (!is_string(path))
+        return_error("not a path", path);
+    string name = lstring_copy(path);
+    int fd = open(name.c_str(), flags | O_CLOEXEC, 0666);
+    if (fd < 0)
+        return_error("cannot open file", path);
+    return make_cell(TypePort, new Port(fd, input, true, name));
+}
+
+// write or display
+static Cell *print_to_port(Cell *args, bool readable) {
+    Port *port = output_port_arg(cdr(args));
+    Printer printer(false, readable);
+    printer.print(car(args));
+    port->write(printer.str().data(), printer.size());
+    if (port->fd == 2)
+        port->flush();
+    return nil();
+}
+
+prim_pairs port_prims() {
+    return {
+        make_pair("open-input-file", +[](Cell* args) {
+            return open_file(car(args), O_RDONLY, true);
+        }),
+        // (open-output-file path [append?]), truncates unless appending
+        make_pair("open-output-file", +[](Cell* args) {
+            int mode = !null(cdr(args)) && !null(cadr(args))
+                ? O_APPEND : O_TRUNC;
+            return open_file(car(args), O_WRONLY | O_CREAT | mode, false);
+        }),
+        make_pair("open-input-string", +[](Cell* args) {
+            if (!is_string(car(args)))
+                return_error("not a string", car(args));
+            Port *port = new_string_port(string_chars(car(args)),
+                                         string_len(car(args)));
+            return make_cell(TypePort, port);
+        }),
+        make_pair("close-port", +[](Cell* args) {
+            if (!is_port(car(args)))
+                return_error("not a port", car(args));
+            as_port(car(args))->close();
+            return nil();
+        }),
+        make_pair("port?", +[](Cell* args) {
+            return to_lisp_bool(is_port(car(args)));
+        }),
+        make_pair("input-port?", +[](Cell* args) {
+            return to_lisp_bool(is_port(car(args))
+                                && as_port(car(args))->input);
+        }),
+        make_pair("output-port?", +[](Cell* args) {
+            return to_lisp_bool(is_port(car(args))
+                                && !as_port(car(args))->input);
+        }),
+        make_pair("current-input-port", +[](Cell* args) {
+            return stdin_port();
+        }),
+        make_pair("current-output-port", +[](Cell* args) {
+            return stdout_port();
+        }),
+        make_pair("current-error-port", +[](Cell* args) {
+            return stderr_port();
+        }),
+        make_pair("eof-object", +[](Cell* args) {
+            return eof_object();
+        }),
+        make_pair("eof-object?", +[](Cell* args) {
+            return to_lisp_bool(is_eof_object(car(args)));
+        }),
+        make_pair("read-line", +[](Cell* args) {
+            Port *port = input_port_arg(args);
+            string line;
+            if (!port->read_line(line))
+                return eof_object();
+            return make_string(line.data(), line.size());
+        }),
+        // (read-bytes n [port]), fewer than n only at end of input
+        make_pair("read-bytes", +[](Cell* args) {
+            Cell *n = car(args);
+            if (!is_integer(n) || n->as_long() < 0)
+                return_error("not a count", n);
+            Port *port = input_port_arg(cdr(args));
+            string bytes;
+            if (port->read(bytes, n->as_long()) == 0 && n->as_long() > 0)
+                return eof_object();
+            return make_string(bytes.data(), bytes.size());
+        }),
+        make_pair("read", +[](Cell* args) {
+            return lisp_read(input_port_arg(args));
+        }),
+        make_pair("write", +[](Cell* args) {
+            return print_to_port(args, true);
+        }),
+        make_pair("display", +[](Cell* args) {
+            return print_to_port(args, false);
+        }),
+        make_pair("newline", +[](Cell* args) {
+            output_port_arg(args)->write("\n", 1);
+            return nil();
+        }),
+        make_pair("flush-output", +[](Cell* args) {
+            output_port_arg(args)->flush();
+            return nil();
+        }),
+    };
+}
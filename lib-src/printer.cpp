@@ -0,0 +1,290 @@
+
+#include "printer.hpp"
+#include "data.hpp"
+#include "error.hpp"
+#include "number.hpp"
+#include "vector.hpp"
+#include "hashtable.hpp"
+#include "lstring.hpp"
+#include "record.hpp"
+#include "stream.hpp"
+#include "values.hpp"
+#include "port.hpp"
+#include "future.hpp"
+#include "green.hpp"
+
+// First pass for `circle` printing: walk every pair once and flag the
+// ones that are reached more than once.
+void Printer::scan(Cell *exp) {
+    labels.clear();
+    stack.clear();
+    stack.push_back(exp);
+    while (!stack.empty()) {
+        Cell *e = stack.back();
+        stack.pop_back();
+        // follow the cdr chain in place, queue the cars
+        while (e && is_pair(e)) {
+            auto it = labels.find(e);
+            if (it != labels.end()) {
+                it->second = -1;
+                break;
+            }
+            labels[e] = 0;
+            stack.push_back(car(e));
+            e = cdr(e);
+        }
+    }
+}
+
+// Emits `#n=` the first time a shared pair is printed and `#n#` after.
+// Returns true when only the back reference was written.
+bool Printer::print_label(Cell *exp) {
+    auto it = labels.find(exp);
+    if (it == labels.end() || it->second == 0)
+        return false;
+
+    char tmp[32];
+    if (it->second > 0) {
+        snprintf(tmp, sizeof(tmp), "#%ld#", it->second - 1);
+        buf.append(tmp);
+        return true;
+    }
+    it->second = ++next_label;
+    snprintf(tmp, sizeof(tmp), "#%ld=", it->second - 1);
+    buf.append(tmp);
+    return false;
+}
+
+void Printer::print_atom(Cell *exp) {
+    char tmp[64];
+    if (exp == NULL || null(exp)) {
+        buf.append("nil");
+    }
+    else if (is_symbol(exp)) {
+        buf.append((char *)exp->val);
+    }
+    else if (is_string(exp) && readable) {
+        buf.push_back('"');
+        for (size_t i = 0; i < string_len(exp); i++) {
+            char c = string_chars(exp)[i];
+            if (c == '"' || c == '\\')
+                buf.append(1, '\\').push_back(c);
+            else if (c == '\n')
+                buf.append("\\n");
+            else if (c == '\t')
+                buf.append("\\t");
+            else
+                buf.push_back(c);
+        }
+        buf.push_back('"');
+    }
+    else if (is_string(exp)) {
+        buf.append(string_chars(exp), string_len(exp));
+    }
+    else if (is_procedure(exp)) {
+        snprintf(tmp, sizeof(tmp), "<Proc %p>", (void *)exp);
+        buf.append(tmp);
+    }
+    else if (is_integer(exp)) {
+        snprintf(tmp, sizeof(tmp), "%ld", exp->as_long());
+        buf.append(tmp);
+    }
+    else if (is_float(exp)) {
+        snprintf(tmp, sizeof(tmp), "%.15g", exp->as_double());
+        buf.append(tmp);
+    }
+    else if (is_bignum(exp)) {
+        buf.append(as_bignum(exp)->to_string());
+    }
+    else if (is_numvector(exp)) {
+        NumVector *vec = as_numvector(exp);
+        buf.append(is_f64vector(exp) ? "#f64(" : "#s64(");
+        for (size_t i = 0; i < vec->len; i++) {
+            if (is_f64vector(exp))
+                snprintf(tmp, sizeof(tmp), "%.15g", vec->f64()[i]);
+            else
+                snprintf(tmp, sizeof(tmp), "%ld", (long)vec->s64()[i]);
+            if (i > 0)
+                buf.push_back(' ');
+            buf.append(tmp);
+        }
+        buf.push_back(')');
+    }
+    else if (is_ratio(exp)) {
+        buf.append(as_ratio(exp)->num.to_string()).push_back('/');
+        buf.append(as_ratio(exp)->den.to_string());
+    }
+    else if (is_hashtable(exp)) {
+        snprintf(tmp, sizeof(tmp), "<HashTable %zu %p>",
+                 as_hashtable(exp)->count, (void *)exp);
+        buf.append(tmp);
+    }
+    else if (is_string_builder(exp)) {
+        snprintf(tmp, sizeof(tmp), "<StringBuilder %zu %p>",
+                 as_string_builder(exp)->size(), (void *)exp);
+        buf.append(tmp);
+    }
+    else if (is_record(exp)) {
+        print_record(exp);
+    }
+    else if (is_record_type(exp)) {
+        buf.append("<RecordType ");
+        buf.append(as_record_type(exp)->name->as_char_str()).push_back('>');
+    }
+    else if (is_record_proc(exp)) {
+        buf.append("<RecordProc ");
+        buf.append(as_record_proc(exp)->name->as_char_str());
+        snprintf(tmp, sizeof(tmp), " %p>", (void *)exp);
+        buf.append(tmp);
+    }
+    else if (is_promise(exp)) {
+        snprintf(tmp, sizeof(tmp), "<Promise %p>", (void *)exp);
+        buf.append(tmp);
+    }
+    else if (is_values(exp)) {
+        // what the REPL gets back from (values ...), printed space
+        // separated
+        Printer inner(circle, readable);
+        for (size_t i = 0; i < values_buffer.size(); i++) {
+            if (i > 0)
+                buf.push_back(' ');
+            buf.append(inner.print(values_buffer[i]).str());
+            inner.clear();
+        }
+    }
+    else if (is_port(exp)) {
+        buf.append("<Port ").append(as_port(exp)->name);
+        snprintf(tmp, sizeof(tmp), " %p>", (void *)exp);
+        buf.append(tmp);
+    }
+    else if (is_future(exp)) {
+        snprintf(tmp, sizeof(tmp), "<Future %s%p>",
+                 as_future(exp)->state.load() == FutureDone ? "done " : "",
+                 (void *)exp);
+        buf.append(tmp);
+    }
+    else if (is_green_thread(exp)) {
+        snprintf(tmp, sizeof(tmp), "<GreenThread %s%p>",
+                 as_green_thread(exp)->state == GreenDone ? "done " : "",
+                 (void *)exp);
+        buf.append(tmp);
+    }
+    else if (is_channel(exp)) {
+        snprintf(tmp, sizeof(tmp), "<Channel %zu/%zu %p>",
+                 as_channel(exp)->items.size(), as_channel(exp)->cap,
+                 (void *)exp);
+        buf.append(tmp);
+    }
+    else if (is_eof_object(exp)) {
+        buf.append("#<eof>");
+    }
+    else if (is_primitive(exp)) {
+        buf.append("<Prim ").append(prim_name(exp));
+        snprintf(tmp, sizeof(tmp), " %p>", (void *)exp);
+        buf.append(tmp);
+    }
+    else {
+        snprintf(tmp, sizeof(tmp), "print: unsupported exp type=%d", exp->type);
+        buf.append(tmp);
+    }
+}
+
+// #S(point x 1 y 2), slots go through a nested printer, so records
+// nested deeper than RECORD_PRINT_DEPTH are elided
+#define RECORD_PRINT_DEPTH 8
+
+void Printer::print_record(Cell *exp) {
+    static thread_local int depth = 0;
+    RecordType *rt = record_type_of(exp);
+    buf.append("#S(").append(rt->name->as_string());
+    if (depth >= RECORD_PRINT_DEPTH) {
+        buf.append(" ...)");
+        return;
+    }
+    depth++;
+    Printer inner(circle, readable);
+    for (size_t i = 0; i < rt->fields.size(); i++) {
+        buf.push_back(' ');
+        buf.append(rt->fields[i]->as_string()).push_back(' ');
+        buf.append(inner.print(as_record(exp)->slots()[i]).str());
+        inner.clear();
+    }
+    depth--;
+    buf.push_back(')');
+}
+
+Printer& Printer::print(Cell *exp) {
+    if (circle)
+        scan(exp);
+    next_label = 0;
+    stack.clear();
+
+    for (;;) {
+        // print exp, lists are opened here and finished below
+        if (circle && print_label(exp)) {
+            // back reference already written
+        }
+        else if (exp && is_pair(exp)) {
+            buf.push_back('(');
+            stack.push_back(cdr(exp));
+            exp = car(exp);
+            continue;
+        }
+        else if (exp && is_error(exp)) {
+            LispError *err = as_error(exp);
+            buf.append("ERROR: ").append(err->where)
+                .append(", ").append(err->msg);
+            if (!null(err->irritant)) {
+                // the irritant is printed in place of the error
+                buf.append(", ");
+                exp = err->irritant;
+                continue;
+            }
+        }
+        else {
+            print_atom(exp);
+        }
+
+        // close the finished lists, until there is another element
+        for (;;) {
+            if (stack.empty())
+                return *this;
+            Cell *rest = stack.back();
+            if (rest == NULL || null(rest)) {
+                buf.push_back(')');
+                stack.pop_back();
+            }
+            else if (!is_pair(rest)
+                     || (circle && labels.count(rest) && labels[rest] != 0)) {
+                // dotted tail, or a tail that needs its own label
+                buf.append(" . ");
+                stack.back() = nil();
+                exp = rest;
+                break;
+            }
+            else {
+                buf.push_back(' ');
+                stack.back() = cdr(rest);
+                exp = car(rest);
+                break;
+            }
+        }
+    }
+}
+
+void Printer::flush(ostream &out) {
+    out.write(buf.data(), buf.size());
+    buf.clear();
+}
+
+void Printer::flush(FILE *out) {
+    fwrite(buf.data(), 1, buf.size(), out);
+    buf.clear();
+}
+
+ostream& operator<<(ostream &out, Cell *exp) {
+    // one buffer per thread, reused across calls
+    static thread_local Printer printer;
+    printer.print(exp).flush(out);
+    return out;
+}
@@ -1,5 +1,6 @@
 
 #include <ctype.h>
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,50 +8,64 @@
 
 #include "reader.hpp"
 #include "lisp.hpp"
+#include "number.hpp"
+#include "lstring.hpp"
+#include "port.hpp"
+#include "list.hpp"
+#include "error.hpp"
+#include "limits.hpp"
 
 
-int is_space(char x) { return x == ' ' || x == '\n'; }
-int is_parens(char x) { return x == '(' || x == ')'; }
-int is_double_quotes(char x) { return x == '"'; }
+int is_space(int x) {
+    return x == ' ' || x == '\n' || x == '\t' || x == '\r';
+}
+int is_parens(int x) { return x == '(' || x == ')'; }
+int is_double_quotes(int x) { return x == '"'; }
 
-#define SYMBOL_MAX 32
 #define is_valid_char(look) (look != EOF                    \
                              && !is_space(look)             \
                              && !is_parens(look)            \
                              && !is_double_quotes(look))
 
-static char get_next_char(FILE *input) {
-    char look = getc(input);
-    while(is_space(look)) { look = getc(input); }
-    return look;
+// the next char that is not white space or in a ; comment
+static int get_next_char(Port *input) {
+    int look = input->getc();
+    for (;;) {
+        if (look == ';') {
+            while (look != '\n' && look != EOF)
+                look = input->getc();
+        } else if (!is_space(look)) {
+            return look;
+        }
+        look = input->getc();
+    }
 }
 
-static char *gettoken(FILE *input) {
-    int index = 0;
-    char token[SYMBOL_MAX]; /* token */
-    char look = get_next_char(input);
-
-    if (look == EOF) {
-        exit(1);
+// tokens are as long as they need to be, look is their first char
+static string gettoken(Port *input, int look) {
+    string token;
+    if (is_parens(look) || is_double_quotes(look)) {
+        token.push_back(look);
+        return token;
     }
-    else if (is_parens(look) || is_double_quotes(look)) {
-        token[index++] = look;
+    while (is_valid_char(look)) {
+        token.push_back(look);
+        look = input->getc();
     }
-    else {
-        while(index < SYMBOL_MAX - 1 && is_valid_char(look)) {
-            token[index++] = look;
-            look = getc(input);
-        }
-        // put the extra char read back into
-        ungetc(look, input);
-    }
-    token[index] = '\0';
-    return strdup(token);
+    // put the extra char read back into
+    if (look != EOF)
+        input->unget();
+    return token;
 }
 
 LispType getNumType(char *token, LispType t)
 {
-    if (isdigit(*token)) {
+    if (t == TypeUnknown && (*token == '-' || *token == '+')
+        && isdigit(token[1])) {
+        // leading sign
+        return getNumType(token + 1, t);
+    }
+    else if (isdigit(*token)) {
         return getNumType(token + 1,
                           t == TypeUnknown ? TypeInt : t);
     }
@@ -67,12 +82,18 @@ LispType getNumType(char *token, LispType t)
     return TypeUnknown;
 }
 
-Cell *getlist(FILE *input);
-Cell *getstring(FILE *input);
+Cell *getlist(Port *input);
+Cell *getstring(Port *input);
 Cell *getnumber(LispType t, char *token);
 
-Cell *getobj(FILE *input) {
-    char *token = gettoken(input);
+Cell *getobj(Port *input) {
+    int look = get_next_char(input);
+    if (look == EOF)
+        return eof_object();
+    if (look == ')')
+        return_error("unexpected )", nil());
+    string buf = gettoken(input, look);
+    char *token = &buf[0];
     LispType type = TypeUnknown;
 
     /* debuglog("Getting obj start, %s\n", token); */
@@ -85,85 +106,161 @@ Cell *getobj(FILE *input) {
     return intern(token);
 }
 
-Cell *getlist(FILE *input) {
-
-    /* debuglogln("Getting list start"); */
-    // N/A -- check for missing closing paren
-    // stdin will hang when list is not balanced.
-
-    char peek = get_next_char(input); 
-    if (peek == ')')
-        return nil();
-    ungetc(peek, input);
-    return cons(getobj(input), getlist(input));
+// Reads up to the ) closing the list being read, past the lists,
+// strings and comments in it, so a list that failed is not read again
+// as more input.
+static void skip_list(Port *input) {
+    int depth = 1;
+    int look;
+    while (depth > 0 && (look = input->getc()) != EOF) {
+        if (look == '(') {
+            depth++;
+        } else if (look == ')') {
+            depth--;
+        } else if (look == ';') {
+            while (look != '\n' && look != EOF)
+                look = input->getc();
+        } else if (look == '"') {
+            while ((look = input->getc()) != '"' && look != EOF) {
+                if (look == '\\')
+                    input->getc();
+            }
+        }
+    }
 }
 
-Cell *getstring(FILE *input) {
+// The opening paren is already read; built front to back, a long list
+// does not recurse, and into runs as code and quoted data are mostly
+// walked. Nested lists do recurse, so a list nested too deep for the
+// stack left is an error, tagged too-deep, instead of a crash.
+Cell *getlist(Port *input) {
+    if (stack_exhausted()) {
+        skip_list(input);
+        Cell *err = make_error(__func__, "too-deep", nil());
+        as_error(err)->tag = intern("too-deep");
+        return err;
+    }
+    RunBuilder out;
+    try {
+        for (;;) {
+            int peek = get_next_char(input);
+            if (peek == ')')
+                return out.result();
+            if (peek == EOF)
+                return_error("missing closing )", out.result());
+            input->unget();
+            Cell *obj = getobj(input);
+            if (is_error(obj)) {
+                skip_list(input);
+                return obj;
+            }
+            out.add(obj);
+        }
+    } catch (LispException &e) {
+        // out of memory, the heap is full
+        skip_list(input);
+        return e.err;
+    }
+}
 
-    char *token = gettoken(input);
-    /* debuglog("Getting list start with content %s\n", token); */
-    Cell *tmp = make_cell(TypeString, token);
-    token = gettoken(input);
-    if (token[0] != '"') {
-        printf("error reading string, missing \"\n");
-        return nil();
+// the opening quote is already read, \" \\ \n and \t are escapes
+Cell *getstring(Port *input) {
+    string chars;
+    int look;
+    while ((look = input->getc()) != '"') {
+        if (look == '\\') {
+            look = input->getc();
+            if (look == 'n')
+                look = '\n';
+            else if (look == 't')
+                look = '\t';
+        }
+        if (look == EOF)
+            return_error("missing closing \"", make_string(chars.data(),
+                                                            chars.size()));
+        chars.push_back(look);
     }
-    return tmp;
+    return make_string(chars.data(), chars.size());
 }
 
 Cell *getnumber(LispType type, char *token)
 {
     /* debuglogln("Getting number start"); */
     if (type == TypeInt) {
-        return make_cell(type, (void *)atoi(token));
+        errno = 0;
+        long n = strtol(token, NULL, 10);
+        if (errno == ERANGE)
+            return make_integer(BigInt::from_string(token));
+        return make_fixnum(n);
     }
     if (type == TypeFloat) {
-        float f = atof(token);
-        void* x = *reinterpret_cast<void**>(&f);
-        return make_cell(type, x);
+        return make_flonum(strtod(token, NULL));
+    }
+    if (type == TypeRatio) {
+        char *slash = strchr(token, '/');
+        *slash = '\0';
+        BigInt den = BigInt::from_string(slash + 1);
+        if (den.is_zero())
+            return_error("division by zero", nil());
+        return make_rational(BigInt::from_string(token), den);
     }
     return nil();
 }
 
-Cell *lisp_read(FILE* input)
+// allocating may fail like in eval, that is returned too
+static Cell *getobj_caught(Port *input) {
+    lock_guard<recursive_mutex> g(input->lock);
+    try {
+        return getobj(input);
+    } catch (LispException &e) {
+        return e.err;
+    }
+}
+
+Cell *lisp_read(Port *input)
 {
-    prog1(Cell*, res, getobj(input),
+    prog1(Cell*, res, getobj_caught(input),
           debuglog("read finished. total obj = %d, just read obj = %d\n",
                    getVM()->numObjs(),
                    res->count_obj()));
     // return getobj(input);
 }
 
-#include <sys/types.h>
-#include <stdlib.h>
-#include <unistd.h>
-
-Cell *read_from_string(const char* string) {
-    pid_t pid;
-    int pipeIDs[2];
-
-    if (pipe(pipeIDs)) {
-        fprintf (stderr, "ERROR, cannot create pipe.\n");
-        return nil();
-    } 
-
-    pid = fork();
-    if (pid == (pid_t) 0) {
-        /* Write to PIPE in this THREAD  */
-
-        FILE * file = fdopen( pipeIDs[1], "w");
-
-        fprintf(file, "%s", string);
-        return nil();
-
-    } else if (pid < (pid_t) 0) {
-        fprintf (stderr, "ERROR, cannot create thread.\n");
-        return nil();
+size_t datum_end(const char *buf, size_t len) {
+    int depth = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = buf[i];
+        if (c == ';') {
+            while (i < len && buf[i] != '\n')
+                i++;
+        } else if (c == '"') {
+            for (i++; i < len && buf[i] != '"'; i++) {
+                if (buf[i] == '\\')
+                    i++;
+            }
+            if (i >= len)
+                return 0;
+            if (depth == 0)
+                return i + 1;
+        } else if (c == '(') {
+            depth++;
+        } else if (c == ')') {
+            // a stray ) is a request too, the reader rejects it
+            if (depth <= 1)
+                return i + 1;
+            depth--;
+        } else if (!is_space(c) && depth == 0) {
+            while (i < len && is_valid_char((unsigned char)buf[i]))
+                i++;
+            return i < len ? i : 0;
+        }
     }
+    return 0;
+}
 
-    FILE* myFile = fdopen(pipeIDs[0], "r");
-    Cell *obj = lisp_read(myFile);
-    fclose(myFile);
+Cell *read_from_string(const char* string) {
+    Port *port = new_string_port(string, strlen(string));
+    Cell *obj = lisp_read(port);
+    delete port;
     return obj;
 }
-
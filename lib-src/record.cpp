@@ -0,0 +1,87 @@
+
+#include "record.hpp"
+
+static Cell *make_record(Cell *type) {
+    size_t n = as_record_type(type)->fields.size();
+    Record *rec = (Record*)malloc(sizeof(Record) + n * sizeof(Cell*));
+    if (rec == NULL)
+        error("cannot allocate record", type);
+    rec->type = type;
+    for (size_t i = 0; i < n; i++)
+        rec->slots()[i] = nil();
+    return make_cell(TypeRecord, rec);
+}
+
+void free_record(Record *rec) {
+    free(rec);
+}
+
+void mark_record(Cell *rec) {
+    as_record(rec)->type->mark();
+    for (size_t i = 0; i < record_size(rec); i++)
+        as_record(rec)->slots()[i]->mark();
+}
+
+//
+
+static Cell *define_record_proc(Environment *env, Cell *type, RecordOp op,
+                                size_t slot, const string &name) {
+    Cell *sym = intern(name.c_str());
+    RecordProc *proc = new RecordProc{op, type, slot, sym};
+    return env_add_var_def(sym, make_cell(TypeRecordProc, proc), env);
+}
+
+Cell *eval_defstruct(Cell *exp, Environment *env) {
+    Cell *name = cadr(exp);
+    ensure(name, TypeSymbol);
+    RecordType *rt = new RecordType();
+    rt->name = name;
+    dolist_cdr(c, cddr(exp)) {
+        if (!is_symbol(car(c))) {
+            delete rt;
+            return_error("field name is not a symbol", car(c));
+        }
+        rt->fields.push_back(car(c));
+    }
+
+    Cell *type = make_cell(TypeRecordType, rt);
+    string prefix = name->as_string();
+    define_record_proc(env, type, RecordMake, 0, "make-" + prefix);
+    define_record_proc(env, type, RecordPred, 0, prefix + "?");
+    for (size_t i = 0; i < rt->fields.size(); i++) {
+        string field = rt->fields[i]->as_string();
+        define_record_proc(env, type, RecordGet, i, prefix + "-" + field);
+        define_record_proc(env, type, RecordSet, i,
+                           "set-" + prefix + "-" + field + "!");
+    }
+    return name;
+}
+
+Cell *apply_record_proc(Cell *func, Cell *args) {
+    RecordProc *proc = as_record_proc(func);
+    size_t n = as_record_type(proc->type)->fields.size();
+
+    if (proc->op == RecordMake) {
+        // (make-point x y), missing trailing fields are nil
+        Cell *rec = make_record(proc->type);
+        size_t i = 0;
+        dolist_cdr(c, args) {
+            if (i == n)
+                return_error("too many arguments", proc->name);
+            as_record(rec)->slots()[i++] = car(c);
+        }
+        return rec;
+    }
+
+    Cell *rec = car(args);
+    bool is_instance = is_record(rec) && as_record(rec)->type == proc->type;
+    if (proc->op == RecordPred)
+        return to_lisp_bool(is_instance);
+    if (!is_instance)
+        return_error("wrong record type", rec);
+
+    if (proc->op == RecordGet)
+        return as_record(rec)->slots()[proc->slot];
+    check_mutable(rec);
+    return as_record(rec)->slots()[proc->slot] = cadr(args);
+}
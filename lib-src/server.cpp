@@ -0,0 +1,236 @@
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.hpp"
+#include "lisp.hpp"
+#include "reader.hpp"
+#include "printer.hpp"
+#include "error.hpp"
+#include "port.hpp"
+#include "limits.hpp"
+
+#define SERVER_READ_SIZE (64 * 1024)
+#define SERVER_MAX_EVENTS 64
+
+struct Connection {
+    int fd;
+    VM *vm;                     // cloned from the frozen template
+    string in;                  // received, [0, pos) already evaluated
+    size_t pos;
+    string out;                 // results not yet written
+    bool eof;                   // the client has shut down its side
+
+    Connection(int fd, VM *base) :
+        fd(fd), vm(new VM(base)), pos(0), eof(false) {}
+    ~Connection() {
+        close(fd);
+        delete vm;
+    }
+};
+
+static volatile sig_atomic_t stopping = 0;
+// the VM of the request being evaluated, if any
+static std::atomic<VM*> running(NULL);
+
+static void on_stop(int) {
+    stopping = 1;
+    VM *vm = running.load();
+    if (vm)
+        cancel_eval(vm);
+}
+
+bool load_file(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    Port port(fd, true, true, path);
+    Environment *env = getVM()->root_env;
+    for (;;) {
+        Cell *exp = lisp_read(&port);
+        if (is_eof_object(exp))
+            return true;
+        Cell *result = is_error(exp) ? exp : eval_toplevel(exp, env);
+        if (is_error(result)) {
+            Printer printer;
+            printer.write(path).write(": ").print(result).write("\n");
+            printer.flush(stderr);
+        }
+    }
+}
+
+// Evaluates len bytes of request in the connection's VM, appending the
+// printed result to its output.
+static void evaluate(Connection *c, const char *request, size_t len) {
+    VMScope scope(c->vm);
+    Port *port = new_string_port(request, len);
+    Cell *exp = lisp_read(port);
+    delete port;
+    if (is_eof_object(exp))
+        return;
+    running = c->vm;
+    Cell *result = is_error(exp) ? exp
+        : eval_limited(exp, c->vm->root_env,
+                       SERVER_REQUEST_FUEL, SERVER_REQUEST_CELLS);
+    running = NULL;
+    // results may share structure, like at the REPL
+    Printer printer(true, true);
+    printer.print(result);
+    c->out.append(printer.str()).push_back('\n');
+}
+
+// Writes what the socket takes, false once the connection is broken.
+static bool transmit(Connection *c) {
+    size_t done = 0;
+    while (done < c->out.size()) {
+        ssize_t n = send(c->fd, c->out.data() + done, c->out.size() - done,
+                         MSG_NOSIGNAL);
+        if (n > 0)
+            done += n;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+        else if (errno != EINTR)
+            return false;
+    }
+    c->out.erase(0, done);
+    return true;
+}
+
+// Evaluates the complete requests received so far, sending each result
+// off as soon as it is ready. False once the connection is broken.
+static bool serve(Connection *c) {
+    while (c->pos < c->in.size()) {
+        const char *rest = c->in.data() + c->pos;
+        size_t len = datum_end(rest, c->in.size() - c->pos);
+        if (len == 0 && c->eof)
+            len = c->in.size() - c->pos;
+        if (len == 0)
+            break;
+        evaluate(c, rest, len);
+        c->pos += len;
+        if (!transmit(c))
+            return false;
+    }
+    c->in.erase(0, c->pos);
+    c->pos = 0;
+    if (c->in.size() > SERVER_MAX_REQUEST) {
+        c->out.append("ERROR: serve, request too long\n");
+        c->in.clear();
+        c->eof = true;
+    }
+    return true;
+}
+
+// Reads what the client has sent, false once the connection is broken.
+static bool receive(Connection *c) {
+    char buf[SERVER_READ_SIZE];
+    for (;;) {
+        ssize_t n = read(c->fd, buf, sizeof buf);
+        if (n > 0) {
+            c->in.append(buf, n);
+            // the rest once this has been served
+            if (c->in.size() > SERVER_MAX_REQUEST)
+                return true;
+        } else if (n == 0) {
+            c->eof = true;
+            return true;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return true;
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+static int listen_on(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return -1;
+    }
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof addr) < 0
+        || listen(fd, SOMAXCONN) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int run_server(const char *path) {
+    int listener = listen_on(path);
+    if (listener < 0)
+        return 1;
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;         // the listener
+    epoll_ctl(ep, EPOLL_CTL_ADD, listener, &ev);
+
+    struct sigaction sa = {};
+    sa.sa_handler = on_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    VM *base = getVM();
+    base->freeze();
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!stopping) {
+        int n = epoll_wait(ep, events, SERVER_MAX_EVENTS, -1);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            Connection *c = (Connection*)events[i].data.ptr;
+            if (c == NULL) {
+                int fd;
+                while ((fd = accept4(listener, NULL, NULL,
+                                     SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    c = new Connection(fd, base);
+                    ev.events = EPOLLIN;
+                    ev.data.ptr = c;
+                    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+                }
+                continue;
+            }
+
+            bool ok = !(events[i].events & EPOLLERR);
+            if (ok && (events[i].events & (EPOLLIN | EPOLLHUP)) && !c->eof) {
+                ok = receive(c) && serve(c);
+            }
+            if (ok)
+                ok = transmit(c);
+            if (!ok || (c->eof && c->out.empty())) {
+                delete c;       // closing the fd takes it out of ep
+                continue;
+            }
+            // wait for room in the socket while results are queued
+            ev.events = c->out.empty() ? EPOLLIN : EPOLLOUT;
+            if (c->eof)
+                ev.events &= ~EPOLLIN;
+            ev.data.ptr = c;
+            epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+        }
+    }
+
+    close(ep);
+    close(listener);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,277 @@
+
+#include "simd.hpp"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Plain loops, the fallback and the tail of every vector loop.
+
+#define DEF_BINARY_SCALAR(name, T, op)                                  \
+    static void name(T *out, const T *a, const T *b, size_t n) {        \
+        for (size_t i = 0; i < n; i++)                                  \
+            out[i] = a[i] op b[i];                                      \
+    }
+
+DEF_BINARY_SCALAR(f64_add_scalar, double, +)
+DEF_BINARY_SCALAR(f64_sub_scalar, double, -)
+DEF_BINARY_SCALAR(f64_mul_scalar, double, *)
+
+// int64 lanes are added as unsigned, so overflow wraps instead of being UB
+static void s64_add_scalar(int64_t *out, const int64_t *a, const int64_t *b,
+                           size_t n) {
+    for (size_t i = 0; i < n; i++)
+        out[i] = (int64_t)((uint64_t)a[i] + (uint64_t)b[i]);
+}
+
+static void s64_sub_scalar(int64_t *out, const int64_t *a, const int64_t *b,
+                           size_t n) {
+    for (size_t i = 0; i < n; i++)
+        out[i] = (int64_t)((uint64_t)a[i] - (uint64_t)b[i]);
+}
+
+static void f64_scale_scalar(double *out, const double *a, double k, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        out[i] = a[i] * k;
+}
+
+static double f64_dot_scalar(const double *a, const double *b, size_t n) {
+    double acc = 0;
+    for (size_t i = 0; i < n; i++)
+        acc += a[i] * b[i];
+    return acc;
+}
+
+static double f64_sum_scalar(const double *a, size_t n) {
+    double acc = 0;
+    for (size_t i = 0; i < n; i++)
+        acc += a[i];
+    return acc;
+}
+
+static double f64_min_scalar(const double *a, size_t n) {
+    double acc = a[0];
+    for (size_t i = 1; i < n; i++)
+        acc = a[i] < acc ? a[i] : acc;
+    return acc;
+}
+
+static double f64_max_scalar(const double *a, size_t n) {
+    double acc = a[0];
+    for (size_t i = 1; i < n; i++)
+        acc = a[i] > acc ? a[i] : acc;
+    return acc;
+}
+
+#ifdef SIMD_X86
+
+// SSE2, 2 doubles or 2 int64 per register. Part of the x86-64 baseline.
+
+#define DEF_BINARY_SSE2(name, T, vec, load, store, vop, tail)           \
+    static void name(T *out, const T *a, const T *b, size_t n) {        \
+        size_t i = 0;                                                   \
+        for (; i + 2 <= n; i += 2) {                                    \
+            vec x = load((const vec*)(a + i));                          \
+            vec y = load((const vec*)(b + i));                          \
+            store((vec*)(out + i), vop(x, y));                          \
+        }                                                               \
+        tail(out + i, a + i, b + i, n - i);                             \
+    }
+
+#define f64_load(p) _mm_loadu_pd((const double*)(p))
+#define f64_store(p, x) _mm_storeu_pd((double*)(p), x)
+
+DEF_BINARY_SSE2(f64_add_sse2, double, __m128d, f64_load, f64_store,
+                _mm_add_pd, f64_add_scalar)
+DEF_BINARY_SSE2(f64_sub_sse2, double, __m128d, f64_load, f64_store,
+                _mm_sub_pd, f64_sub_scalar)
+DEF_BINARY_SSE2(f64_mul_sse2, double, __m128d, f64_load, f64_store,
+                _mm_mul_pd, f64_mul_scalar)
+DEF_BINARY_SSE2(s64_add_sse2, int64_t, __m128i, _mm_loadu_si128,
+                _mm_storeu_si128, _mm_add_epi64, s64_add_scalar)
+DEF_BINARY_SSE2(s64_sub_sse2, int64_t, __m128i, _mm_loadu_si128,
+                _mm_storeu_si128, _mm_sub_epi64, s64_sub_scalar)
+
+static void f64_scale_sse2(double *out, const double *a, double k, size_t n) {
+    __m128d vk = _mm_set1_pd(k);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(a + i), vk));
+    f64_scale_scalar(out + i, a + i, k, n - i);
+}
+
+static double hsum_sse2(__m128d x) {
+    return _mm_cvtsd_f64(_mm_add_sd(x, _mm_unpackhi_pd(x, x)));
+}
+
+static double f64_dot_sse2(const double *a, const double *b, size_t n) {
+    // two accumulators to hide the add latency
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a + i),
+                                           _mm_loadu_pd(b + i)));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a + i + 2),
+                                           _mm_loadu_pd(b + i + 2)));
+    }
+    return hsum_sse2(_mm_add_pd(acc0, acc1))
+        + f64_dot_scalar(a + i, b + i, n - i);
+}
+
+static double f64_sum_sse2(const double *a, size_t n) {
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_pd(acc0, _mm_loadu_pd(a + i));
+        acc1 = _mm_add_pd(acc1, _mm_loadu_pd(a + i + 2));
+    }
+    return hsum_sse2(_mm_add_pd(acc0, acc1)) + f64_sum_scalar(a + i, n - i);
+}
+
+#define DEF_MINMAX_SSE2(name, vop, scalar)                              \
+    static double name(const double *a, size_t n) {                     \
+        if (n < 2)                                                      \
+            return scalar(a, n);                                        \
+        __m128d acc = _mm_loadu_pd(a);                                  \
+        size_t i = 2;                                                   \
+        for (; i + 2 <= n; i += 2)                                      \
+            acc = vop(acc, _mm_loadu_pd(a + i));                        \
+        double lanes[2];                                                \
+        _mm_storeu_pd(lanes, acc);                                      \
+        double rest[3] = { lanes[0], lanes[1], i < n ? a[i] : lanes[0] }; \
+        return scalar(rest, 3);                                         \
+    }
+
+DEF_MINMAX_SSE2(f64_min_sse2, _mm_min_pd, f64_min_scalar)
+DEF_MINMAX_SSE2(f64_max_sse2, _mm_max_pd, f64_max_scalar)
+
+// AVX, 4 doubles per register, only called when the CPU reports AVX.
+
+#define AVX __attribute__((target("avx")))
+#define AVX2 __attribute__((target("avx2")))
+
+#define DEF_BINARY_AVX(name, vop, tail)                                 \
+    AVX static void name(double *out, const double *a, const double *b, \
+                         size_t n) {                                    \
+        size_t i = 0;                                                   \
+        for (; i + 4 <= n; i += 4)                                      \
+            _mm256_storeu_pd(out + i, vop(_mm256_loadu_pd(a + i),       \
+                                          _mm256_loadu_pd(b + i)));     \
+        tail(out + i, a + i, b + i, n - i);                             \
+    }
+
+DEF_BINARY_AVX(f64_add_avx, _mm256_add_pd, f64_add_sse2)
+DEF_BINARY_AVX(f64_sub_avx, _mm256_sub_pd, f64_sub_sse2)
+DEF_BINARY_AVX(f64_mul_avx, _mm256_mul_pd, f64_mul_sse2)
+
+AVX static void f64_scale_avx(double *out, const double *a, double k, size_t n) {
+    __m256d vk = _mm256_set1_pd(k);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), vk));
+    f64_scale_sse2(out + i, a + i, k, n - i);
+}
+
+AVX static double hsum_avx(__m256d x) {
+    __m128d lo = _mm256_castpd256_pd128(x);
+    __m128d hi = _mm256_extractf128_pd(x, 1);
+    lo = _mm_add_pd(lo, hi);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+AVX static double f64_dot_avx(const double *a, const double *b, size_t n) {
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(a + i),
+                                                 _mm256_loadu_pd(b + i)));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4),
+                                                 _mm256_loadu_pd(b + i + 4)));
+    }
+    return hsum_avx(_mm256_add_pd(acc0, acc1))
+        + f64_dot_sse2(a + i, b + i, n - i);
+}
+
+AVX static double f64_sum_avx(const double *a, size_t n) {
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(a + i));
+        acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(a + i + 4));
+    }
+    return hsum_avx(_mm256_add_pd(acc0, acc1)) + f64_sum_sse2(a + i, n - i);
+}
+
+#define DEF_MINMAX_AVX(name, vop, tail, scalar)                         \
+    AVX static double name(const double *a, size_t n) {                 \
+        if (n < 4)                                                      \
+            return tail(a, n);                                          \
+        __m256d acc = _mm256_loadu_pd(a);                               \
+        size_t i = 4;                                                   \
+        for (; i + 4 <= n; i += 4)                                      \
+            acc = vop(acc, _mm256_loadu_pd(a + i));                     \
+        double lanes[4];                                                \
+        _mm256_storeu_pd(lanes, acc);                                   \
+        double r = scalar(lanes, 4);                                    \
+        if (i < n) {                                                    \
+            double t = tail(a + i, n - i);                              \
+            double both[2] = { r, t };                                  \
+            r = scalar(both, 2);                                        \
+        }                                                               \
+        return r;                                                       \
+    }
+
+DEF_MINMAX_AVX(f64_min_avx, _mm256_min_pd, f64_min_sse2, f64_min_scalar)
+DEF_MINMAX_AVX(f64_max_avx, _mm256_max_pd, f64_max_sse2, f64_max_scalar)
+
+#define DEF_S64_AVX2(name, vop, tail)                                   \
+    AVX2 static void name(int64_t *out, const int64_t *a,               \
+                          const int64_t *b, size_t n) {                 \
+        size_t i = 0;                                                   \
+        for (; i + 4 <= n; i += 4) {                                    \
+            __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));    \
+            __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));    \
+            _mm256_storeu_si256((__m256i*)(out + i), vop(x, y));        \
+        }                                                               \
+        tail(out + i, a + i, b + i, n - i);                             \
+    }
+
+DEF_S64_AVX2(s64_add_avx2, _mm256_add_epi64, s64_add_sse2)
+DEF_S64_AVX2(s64_sub_avx2, _mm256_sub_epi64, s64_sub_sse2)
+
+static SimdKernels pick_kernels() {
+    __builtin_cpu_init();
+    bool avx = __builtin_cpu_supports("avx");
+    bool avx2 = __builtin_cpu_supports("avx2");
+    SimdKernels k = {
+        avx ? f64_add_avx : f64_add_sse2,
+        avx ? f64_sub_avx : f64_sub_sse2,
+        avx ? f64_mul_avx : f64_mul_sse2,
+        avx ? f64_scale_avx : f64_scale_sse2,
+        avx ? f64_dot_avx : f64_dot_sse2,
+        avx ? f64_sum_avx : f64_sum_sse2,
+        avx ? f64_min_avx : f64_min_sse2,
+        avx ? f64_max_avx : f64_max_sse2,
+        avx2 ? s64_add_avx2 : s64_add_sse2,
+        avx2 ? s64_sub_avx2 : s64_sub_sse2,
+        avx2 ? "avx2" : avx ? "avx" : "sse2",
+    };
+    return k;
+}
+
+#else
+
+static SimdKernels pick_kernels() {
+    SimdKernels k = {
+        f64_add_scalar, f64_sub_scalar, f64_mul_scalar, f64_scale_scalar,
+        f64_dot_scalar, f64_sum_scalar, f64_min_scalar, f64_max_scalar,
+        s64_add_scalar, s64_sub_scalar, "scalar",
+    };
+    return k;
+}
+
+#endif
+
+static const SimdKernels kernels = pick_kernels();
+const SimdKernels &simd = kernels;
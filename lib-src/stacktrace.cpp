@@ -1,3 +1,4 @@
+
 #include <execinfo.h>  // for backtrace
 #include <dlfcn.h>     // for dladdr
 #include <cxxabi.h>    // for __cxa_demangle
@@ -7,33 +8,45 @@
 
 // https://gist.github.com/fmela/591333/0e8f9f123c87c1f234cd3050b2dac9c76185bdf1
 
-// A C++ function that will produce a stack trace with demangled function and method names.
-std::string Backtrace(int skip = 1)
+// Turns raw return addresses, as recorded by backtrace(), into readable
+// lines with demangled function and method names. This is the expensive
+// half of a stack trace, so errors keep the addresses and call this only
+// when they are printed.
+std::string SymbolizeFrames(void *const *callstack, int nFrames, int skip = 0)
 {
-	void *callstack[128];
-	const int nMaxFrames = sizeof(callstack) / sizeof(callstack[0]);
 	char buf[1024];
-	int nFrames = backtrace(callstack, nMaxFrames);
+	const int width = 2 + sizeof(void*) * 2;
 
 	std::ostringstream trace_buf;
 	for (int i = skip; i < nFrames; i++) {
 		Dl_info info;
-		if (dladdr(callstack[i], &info)) {
+		if (dladdr(callstack[i], &info) && info.dli_sname) {
 			char *demangled = NULL;
 			int status;
 			demangled = abi::__cxa_demangle(info.dli_sname, NULL, 0, &status);
-			snprintf(buf, sizeof(buf), "%-3d %*0p %s + %zd\n",
-					 i, 2 + sizeof(void*) * 2, callstack[i],
+			snprintf(buf, sizeof(buf), "%-3d %*p %s + %zd\n",
+					 i, width, callstack[i],
 					 status == 0 ? demangled : info.dli_sname,
 					 (char *)callstack[i] - (char *)info.dli_saddr);
 			free(demangled);
 		} else {
-			snprintf(buf, sizeof(buf), "%-3d %*0p\n",
-					 i, 2 + sizeof(void*) * 2, callstack[i]);
+			snprintf(buf, sizeof(buf), "%-3d %*p\n",
+					 i, width, callstack[i]);
 		}
 		trace_buf << buf;
 	}
-	if (nFrames == nMaxFrames)
-		trace_buf << "  [truncated]\n";
 	return trace_buf.str();
-}
\ No newline at end of file
+}
+
+// A C++ function that will produce a stack trace with demangled function and method names.
+std::string Backtrace(int skip = 1)
+{
+	void *callstack[128];
+	const int nMaxFrames = sizeof(callstack) / sizeof(callstack[0]);
+	int nFrames = backtrace(callstack, nMaxFrames);
+
+	std::string trace = SymbolizeFrames(callstack, nFrames, skip);
+	if (nFrames == nMaxFrames)
+		trace += "  [truncated]\n";
+	return trace;
+}
@@ -0,0 +1,226 @@
+
+#include "stream.hpp"
+#include "lisp.hpp"
+#include "list.hpp"
+#include "number.hpp"
+
+void Promise::mark() {
+    if (forced) {
+        value->mark();
+    } else {
+        exp->mark();
+        if (env)
+            env->mark();
+    }
+}
+
+static Cell *new_promise(Cell *exp, Environment *env, PrimLispFn native) {
+    Promise *p = new Promise{false, nil(), exp, env, native};
+    return make_cell(TypePromise, p);
+}
+
+Cell *make_promise(Cell *exp, Environment *env) {
+    return new_promise(exp, env, NULL);
+}
+
+// a promise of native(args), made by the stream primitives
+static Cell *native_promise(PrimLispFn native, Cell *args) {
+    return new_promise(args, NULL, native);
+}
+
+Cell *force(Cell *promise) {
+    if (!is_promise(promise))
+        return promise;
+    Promise *p = as_promise(promise);
+    if (p->forced)
+        return p->value;
+
+    Cell *value = p->native ? p->native(p->exp) : eval(p->exp, p->env);
+    if (is_error(value))
+        return value;
+    value = first_value(value);
+    // forcing the expression may have forced this promise already, the
+    // first value sticks; a promise of a template is forced afresh by
+    // every clone
+    if (is_frozen(promise))
+        return value;
+    if (!p->forced) {
+        p->forced = true;
+        p->value = value;
+        p->exp = nil();
+        p->env = NULL;
+        p->native = NULL;
+    }
+    return p->value;
+}
+
+// (delay exp)
+Cell *eval_delay(Cell *exp, Environment *env) {
+    return make_promise(cadr(exp), env);
+}
+
+// (cons-stream a b), a is evaluated now, b when the cdr is forced
+Cell *eval_cons_stream(Cell *exp, Environment *env) {
+    Cell *head = eval(cadr(exp), env);
+    if (is_error(head))
+        return head;
+    return cons(first_value(head), make_promise(caddr(exp), env));
+}
+
+static Cell *stream_cdr(Cell *s) {
+    if (!is_pair(s))
+        error("not a stream", s);
+    return force(cdr(s));
+}
+
+// The stream argument of an iterative consumer. The argument list stops
+// pointing at the head, so the prefix already walked can be collected
+// while the loop is still running.
+static Cell *take_stream_arg(Cell *args) {
+    Cell *s = car(args);
+    args->set_car(nil());
+    return s;
+}
+
+static long count_arg(Cell *n) {
+    if (!is_integer(n) || n->as_long() < 0)
+        error("not a count", n);
+    return n->as_long();
+}
+
+// (f s)
+static Cell *stream_map(Cell *args) {
+    Cell *s = cadr(args);
+    if (null(s))
+        return nil();
+    if (!is_pair(s))
+        return_error("not a stream", s);
+    Cell *x = check_result(apply1(car(args), car(s)));
+    return cons(x, native_promise(+[](Cell* args) {
+        Cell *rest = check_result(stream_cdr(cadr(args)));
+        return stream_map(cons(car(args), list(rest)));
+    }, args));
+}
+
+// (pred s)
+static Cell *stream_filter(Cell *args) {
+    Cell *pred = car(args), *s = cadr(args);
+    for (; !null(s); s = check_result(stream_cdr(s))) {
+        if (!is_pair(s))
+            return_error("not a stream", s);
+        if (!null(check_result(apply1(pred, car(s))))) {
+            return cons(car(s), native_promise(+[](Cell* args) {
+                Cell *rest = check_result(stream_cdr(cadr(args)));
+                return stream_filter(cons(car(args), list(rest)));
+            }, cons(pred, list(s))));
+        }
+    }
+    return nil();
+}
+
+// (s n)
+static Cell *stream_take(Cell *args) {
+    Cell *s = car(args);
+    long n = count_arg(cadr(args));
+    if (n == 0 || null(s))
+        return nil();
+    if (!is_pair(s))
+        return_error("not a stream", s);
+    return cons(car(s), native_promise(+[](Cell* args) {
+        Cell *rest = check_result(stream_cdr(car(args)));
+        long n = cadr(args)->as_long() - 1;
+        return stream_take(cons(rest, list(make_fixnum(n))));
+    }, args));
+}
+
+// the stream after its first n elements, nil if it is shorter
+static Cell *stream_drop(Cell *s, long n) {
+    for (; n > 0 && !null(s); n--)
+        s = check_result(stream_cdr(s));
+    return s;
+}
+
+prim_pairs stream_prims() {
+    return {
+        make_pair("force", +[](Cell* args) {
+            return force(car(args));
+        }),
+        make_pair("promise?", +[](Cell* args) {
+            return is_promise(car(args)) ? lisp_true : nil();
+        }),
+        // (make-promise x), an already forced promise of x
+        make_pair("make-promise", +[](Cell* args) {
+            if (is_promise(car(args)))
+                return car(args);
+            Cell *p = make_promise(nil(), NULL);
+            as_promise(p)->forced = true;
+            as_promise(p)->value = car(args);
+            return p;
+        }),
+        make_pair("stream-pair?", +[](Cell* args) {
+            return is_pair(car(args)) && is_promise(cdr(car(args)))
+                ? lisp_true : nil();
+        }),
+        make_pair("stream-null?", +[](Cell* args) {
+            return null(car(args)) ? lisp_true : nil();
+        }),
+        make_pair("stream-car", +[](Cell* args) {
+            if (!is_pair(car(args)))
+                return_error("not a stream", car(args));
+            return car(car(args));
+        }),
+        make_pair("stream-cdr", +[](Cell* args) {
+            return stream_cdr(car(args));
+        }),
+        // (stream-map f s), lazy
+        make_pair("stream-map", +[](Cell* args) {
+            return stream_map(args);
+        }),
+        // (stream-filter pred s), lazy
+        make_pair("stream-filter", +[](Cell* args) {
+            return stream_filter(args);
+        }),
+        // (stream-take s n), a lazy stream of the first n elements
+        make_pair("stream-take", +[](Cell* args) {
+            return stream_take(args);
+        }),
+        // (stream-drop s n)
+        make_pair("stream-drop", +[](Cell* args) {
+            long n = count_arg(cadr(args));
+            return stream_drop(take_stream_arg(args), n);
+        }),
+        // (stream-ref s n)
+        make_pair("stream-ref", +[](Cell* args) {
+            long n = count_arg(cadr(args));
+            Cell *s = check_result(stream_drop(take_stream_arg(args), n));
+            if (!is_pair(s))
+                return_error("stream too short", cadr(args));
+            return car(s);
+        }),
+        // (stream->list s [n]), at most n elements when n is given
+        make_pair("stream->list", +[](Cell* args) {
+            long n = null(cdr(args)) ? -1 : count_arg(cadr(args));
+            Cell *s = take_stream_arg(args);
+            Cell *out = nil();
+            for (; n != 0 && !null(s); n--) {
+                if (!is_pair(s))
+                    return_error("not a stream", s);
+                out = cons(car(s), out);
+                s = check_result(stream_cdr(s));
+            }
+            return reverse(out);
+        }),
+        // (stream-for-each f s), runs in constant space on a stream
+        // nothing else holds on to
+        make_pair("stream-for-each", +[](Cell* args) {
+            Cell *fn = car(args);
+            Cell *s = take_stream_arg(cdr(args));
+            for (; !null(s); s = check_result(stream_cdr(s))) {
+                if (!is_pair(s))
+                    return_error("not a stream", s);
+                check_result(apply1(fn, car(s)));
+            }
+            return nil();
+        }),
+    };
+}
@@ -0,0 +1,87 @@
+
+#include <chrono>
+#include "trace.hpp"
+#include "lstring.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define read_ticks() __rdtsc()
+#else
+#define read_ticks() ((uint64_t)std::chrono::steady_clock::now()      \
+                      .time_since_epoch().count())
+#endif
+
+std::atomic<bool> trace_enabled(getenv("LISP_TRACE") != NULL);
+
+static TraceEvent ring[TRACE_RING_SIZE];
+static std::atomic<uint64_t> ring_head(0);
+
+static const char *trace_kind_names[] = { "eval", "apply", "alloc", "gc" };
+
+void trace_record(TraceKind kind, Cell *obj, void *arg) {
+    uint64_t i = ring_head.fetch_add(1, std::memory_order_relaxed);
+    TraceEvent &ev = ring[i & (TRACE_RING_SIZE - 1)];
+    ev.ticks = read_ticks();
+    ev.kind = kind;
+    ev.type = obj ? obj->type : TypeUnknown;
+    ev.obj = obj;
+    ev.arg = arg;
+}
+
+void trace_start() { trace_enabled.store(true); }
+void trace_stop() { trace_enabled.store(false); }
+
+// oldest event still held by the ring
+static uint64_t trace_first(uint64_t head) {
+    return head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+}
+
+void trace_dump(FILE *out) {
+    uint64_t head = ring_head.load();
+    uint64_t first = trace_first(head);
+    uint64_t t0 = ring[first & (TRACE_RING_SIZE - 1)].ticks;
+
+    fprintf(out, ";;; trace: %lu events, showing last %lu\n",
+            (unsigned long)head, (unsigned long)(head - first));
+    for (uint64_t i = first; i < head; i++) {
+        TraceEvent &ev = ring[i & (TRACE_RING_SIZE - 1)];
+        fprintf(out, "%10lu %-5s type=%-2d obj=%p arg=%p\n",
+                (unsigned long)(ev.ticks - t0), trace_kind_names[ev.kind],
+                ev.type, ev.obj, ev.arg);
+    }
+}
+
+// raw events, oldest first, for offline tools
+void trace_dump_binary(FILE *out) {
+    uint64_t head = ring_head.load();
+    for (uint64_t i = trace_first(head); i < head; i++)
+        fwrite(&ring[i & (TRACE_RING_SIZE - 1)], sizeof(TraceEvent), 1, out);
+}
+
+prim_pairs trace_prims() {
+    return {
+        make_pair("trace-start", +[](Cell* args) {
+            trace_start();
+            return lisp_true;
+        }),
+        make_pair("trace-stop", +[](Cell* args) {
+            trace_stop();
+            return lisp_true;
+        }),
+        // (trace-dump) prints the ring, (trace-dump "file") writes it raw
+        make_pair("trace-dump", +[](Cell* args) {
+            if (null(args)) {
+                trace_dump(stdout);
+                return lisp_true;
+            }
+            Cell *path = car(args);
+            ensure(path, TypeString);
+            FILE *out = fopen(lstring_copy(path).c_str(), "wb");
+            if (out == NULL)
+                return_error("cannot open", path);
+            trace_dump_binary(out);
+            fclose(out);
+            return lisp_true;
+        }),
+    };
+}
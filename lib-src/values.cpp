@@ -0,0 +1,95 @@
+
+#include "values.hpp"
+#include "lisp.hpp"
+
+thread_local vector<Cell*> values_buffer;
+
+Cell *values_marker() {
+    static Cell *marker = permanent(Cell(TypeValues));
+    return marker;
+}
+
+Cell *values2(Cell *a, Cell *b) {
+    values_buffer.clear();
+    values_buffer.push_back(a);
+    values_buffer.push_back(b);
+    return values_marker();
+}
+
+Cell *apply_values(Cell *fn, Cell *result) {
+    if (!is_values(result))
+        return apply1(fn, result);
+    if (is_primitive(fn) || !STACK_LISTS) {
+        Cell *args = nil();
+        for (size_t i = values_buffer.size(); i-- > 0;)
+            args = cons(values_buffer[i], args);
+        return apply(fn, args);
+    }
+    // only read while binding, like the argument lists of apply1
+    size_t n = values_buffer.size();
+    vector<Cell> args(n, Cell(TypePair, NULL, nil()));
+    for (size_t i = 0; i < n; i++) {
+        args[i].set_car(values_buffer[i]);
+        if (i + 1 < n)
+            args[i].set_cdr(&args[i + 1]);
+    }
+    return apply(fn, n ? &args[0] : nil());
+}
+
+// Binds the values of result to formals, a list of symbols that may end
+// in a dotted rest symbol, or a single symbol taking them all as a list.
+static void bind_values(Cell *formals, Cell *result, Environment *env) {
+    Cell **vals = &result;
+    size_t n = 1;
+    if (is_values(result)) {
+        vals = values_buffer.data();
+        n = values_buffer.size();
+    }
+
+    size_t i = 0;
+    Cell *var = formals;
+    for (; is_pair(var); var = cdr(var), i++) {
+        if (i == n)
+            error("too few values", formals);
+        env_add_var_def(car(var), vals[i], env);
+    }
+    if (null(var)) {
+        if (i < n)
+            error("too many values", formals);
+        return;
+    }
+    Cell *rest = nil();
+    for (size_t j = n; j-- > i;)
+        rest = cons(vals[j], rest);
+    env_add_var_def(var, rest, env);
+}
+
+// (receive formals exp body ...)
+Cell *eval_receive(Cell *exp, Environment *env) {
+    Cell *result = eval(caddr(exp), env);
+    if (is_error(result))
+        return result;
+    Environment *inner = env->extend();
+    bind_values(cadr(exp), result, inner);
+    return eval_sequence(cdr(cddr(exp)), inner);
+}
+
+prim_pairs values_prims() {
+    return {
+        make_pair("values", +[](Cell* args) {
+            if (!null(args) && null(cdr(args)))
+                return car(args);
+            values_buffer.clear();
+            dolist_cdr(c, args) {
+                values_buffer.push_back(car(c));
+            }
+            return values_marker();
+        }),
+        make_pair("call-with-values", +[](Cell* args) {
+            Cell *result = apply(car(args), nil());
+            if (is_error(result))
+                return result;
+            return apply_values(cadr(args), result);
+        }),
+    };
+}
@@ -0,0 +1,265 @@
+
+#include <limits.h>
+#include "vector.hpp"
+#include "number.hpp"
+#include "simd.hpp"
+
+__extension__ typedef __int128 int128;
+__extension__ typedef unsigned __int128 uint128;
+
+Cell *make_numvector(LispType type, size_t len) {
+    void *block;
+    if (len > (SIZE_MAX - sizeof(NumVector)) / sizeof(int64_t))
+        error("bad vector length", make_fixnum(len));
+    if (posix_memalign(&block, alignof(NumVector),
+                       sizeof(NumVector) + len * sizeof(int64_t)))
+        error("cannot allocate vector", make_fixnum(len));
+    NumVector *vec = (NumVector*)block;
+    vec->len = len;
+    return make_cell(type, vec);
+}
+
+void free_numvector(NumVector *vec) {
+    free(vec);
+}
+
+bool numvector_equal(Cell *x, Cell *y) {
+    NumVector *a = as_numvector(x), *b = as_numvector(y);
+    if (a->len != b->len)
+        return false;
+    for (size_t i = 0; i < a->len; i++) {
+        if (is_f64vector(x) ? a->f64()[i] != b->f64()[i]
+                            : a->s64()[i] != b->s64()[i])
+            return false;
+    }
+    return true;
+}
+
+//
+
+static NumVector *check_vector(Cell *x, LispType type) {
+    if (x->type != type)
+        error("wrong vector type", x);
+    return as_numvector(x);
+}
+
+static size_t check_index(NumVector *vec, Cell *i) {
+    if (!is_integer(i) || i->as_long() < 0
+        || (size_t)i->as_long() >= vec->len)
+        error("index out of range", i);
+    return i->as_long();
+}
+
+static int64_t to_s64(Cell *x) {
+    if (!is_integer(x))
+        error("not a fixnum", x);
+    return x->as_long();
+}
+
+static Cell *make_int128(int128 v) {
+    if (v >= LONG_MIN && v <= LONG_MAX)
+        return make_fixnum((long)v);
+    BigInt r;
+    r.neg = v < 0;
+    uint128 u = r.neg ? -(uint128)v : v;
+    for (; u; u >>= 32)
+        r.mag.push_back((uint32_t)u);
+    return make_integer(r);
+}
+
+static void vec_fill(Cell *v, size_t i, Cell *x) {
+    if (is_f64vector(v))
+        as_numvector(v)->f64()[i] = num_to_double(x);
+    else
+        as_numvector(v)->s64()[i] = to_s64(x);
+}
+
+static Cell *vec_elt(Cell *v, size_t i) {
+    return is_f64vector(v)
+        ? make_flonum(as_numvector(v)->f64()[i])
+        : make_fixnum(as_numvector(v)->s64()[i]);
+}
+
+static Cell *vec_from_list(LispType type, Cell *list) {
+    Cell *out = make_numvector(type, length(list));
+    size_t i = 0;
+    dolist_cdr(c, list) {
+        vec_fill(out, i++, car(c));
+    }
+    return out;
+}
+
+static Cell *vec_to_list(Cell *v) {
+    Cell *acc = nil();
+    for (size_t i = as_numvector(v)->len; i-- > 0;)
+        acc = cons(vec_elt(v, i), acc);
+    return acc;
+}
+
+// (make-f64vector n [fill])
+static Cell *vec_make(LispType type, Cell *args) {
+    Cell *n = car(args);
+    if (!is_integer(n) || n->as_long() < 0)
+        error("bad vector length", n);
+    Cell *out = make_numvector(type, n->as_long());
+    Cell *fill = null(cdr(args)) ? make_fixnum(0) : cadr(args);
+    for (size_t i = 0; i < (size_t)n->as_long(); i++)
+        vec_fill(out, i, fill);
+    return out;
+}
+
+enum VecOp { VecAdd, VecSub, VecMul };
+
+static Cell *vec_binary(LispType type, Cell *args, VecOp op) {
+    NumVector *a = check_vector(car(args), type);
+    NumVector *b = check_vector(cadr(args), type);
+    if (a->len != b->len)
+        error("vector lengths differ", cadr(args));
+    Cell *out = make_numvector(type, a->len);
+    NumVector *r = as_numvector(out);
+    size_t n = a->len;
+
+    if (type == TypeF64Vector) {
+        switch (op) {
+        case VecAdd: simd.f64_add(r->f64(), a->f64(), b->f64(), n); break;
+        case VecSub: simd.f64_sub(r->f64(), a->f64(), b->f64(), n); break;
+        case VecMul: simd.f64_mul(r->f64(), a->f64(), b->f64(), n); break;
+        }
+    } else {
+        switch (op) {
+        case VecAdd: simd.s64_add(r->s64(), a->s64(), b->s64(), n); break;
+        case VecSub: simd.s64_sub(r->s64(), a->s64(), b->s64(), n); break;
+        case VecMul:
+            for (size_t i = 0; i < n; i++)
+                r->s64()[i] = (int64_t)((uint64_t)a->s64()[i] * b->s64()[i]);
+            break;
+        }
+    }
+    return out;
+}
+
+static Cell *vec_scale(LispType type, Cell *args) {
+    NumVector *a = check_vector(car(args), type);
+    Cell *out = make_numvector(type, a->len);
+    NumVector *r = as_numvector(out);
+    if (type == TypeF64Vector) {
+        simd.f64_scale(r->f64(), a->f64(), num_to_double(cadr(args)), a->len);
+    } else {
+        uint64_t k = to_s64(cadr(args));
+        for (size_t i = 0; i < a->len; i++)
+            r->s64()[i] = (int64_t)((uint64_t)a->s64()[i] * k);
+    }
+    return out;
+}
+
+// s64 reductions are exact: 128 bit accumulators, bignums past that
+static Cell *vec_dot(LispType type, Cell *args) {
+    NumVector *a = check_vector(car(args), type);
+    NumVector *b = check_vector(cadr(args), type);
+    if (a->len != b->len)
+        error("vector lengths differ", cadr(args));
+    if (type == TypeF64Vector)
+        return make_flonum(simd.f64_dot(a->f64(), b->f64(), a->len));
+
+    int128 acc = 0;
+    for (size_t i = 0; i < a->len; i++) {
+        int128 p = (int128)a->s64()[i] * b->s64()[i], next;
+        if (__builtin_add_overflow(acc, p, &next)) {
+            Cell *big = make_int128(acc);
+            for (; i < a->len; i++)
+                big = num_add(big, num_mul(make_fixnum(a->s64()[i]),
+                                           make_fixnum(b->s64()[i])));
+            return big;
+        }
+        acc = next;
+    }
+    return make_int128(acc);
+}
+
+static Cell *vec_sum(LispType type, Cell *args) {
+    NumVector *a = check_vector(car(args), type);
+    if (type == TypeF64Vector)
+        return make_flonum(simd.f64_sum(a->f64(), a->len));
+    int128 acc = 0;
+    for (size_t i = 0; i < a->len; i++)
+        acc += a->s64()[i];
+    return make_int128(acc);
+}
+
+static Cell *vec_extreme(LispType type, Cell *args, bool want_max) {
+    NumVector *a = check_vector(car(args), type);
+    if (a->len == 0)
+        error("empty vector", car(args));
+    if (type == TypeF64Vector)
+        return make_flonum(want_max ? simd.f64_max(a->f64(), a->len)
+                                    : simd.f64_min(a->f64(), a->len));
+    int64_t acc = a->s64()[0];
+    for (size_t i = 1; i < a->len; i++) {
+        int64_t x = a->s64()[i];
+        acc = want_max ? (x > acc ? x : acc) : (x < acc ? x : acc);
+    }
+    return make_fixnum(acc);
+}
+
+// the same primitive set for both element types
+#define NUMVECTOR_PRIMS(prefix, vtype)                                  \
+    make_pair(prefix "vector", +[](Cell* args) {                        \
+        return vec_from_list(vtype, args);                              \
+    }),                                                                 \
+    make_pair("make-" prefix "vector", +[](Cell* args) {                \
+        return vec_make(vtype, args);                                   \
+    }),                                                                 \
+    make_pair("list->" prefix "vector", +[](Cell* args) {               \
+        return vec_from_list(vtype, car(args));                         \
+    }),                                                                 \
+    make_pair(prefix "vector->list", +[](Cell* args) {                  \
+        check_vector(car(args), vtype);                                 \
+        return vec_to_list(car(args));                                  \
+    }),                                                                 \
+    make_pair(prefix "vector?", +[](Cell* args) {                       \
+        return to_lisp_bool(cell_type(car(args)) == vtype);             \
+    }),                                                                 \
+    make_pair(prefix "vector-length", +[](Cell* args) {                 \
+        return make_fixnum(check_vector(car(args), vtype)->len);        \
+    }),                                                                 \
+    make_pair(prefix "vector-ref", +[](Cell* args) {                    \
+        NumVector *vec = check_vector(car(args), vtype);                \
+        return vec_elt(car(args), check_index(vec, cadr(args)));        \
+    }),                                                                 \
+    make_pair(prefix "vector-set!", +[](Cell* args) {                   \
+        NumVector *vec = check_vector(car(args), vtype);                \
+        check_mutable(car(args));                                       \
+        vec_fill(car(args), check_index(vec, cadr(args)), caddr(args)); \
+        return caddr(args);                                             \
+    }),                                                                 \
+    make_pair(prefix "vector-add", +[](Cell* args) {                    \
+        return vec_binary(vtype, args, VecAdd);                         \
+    }),                                                                 \
+    make_pair(prefix "vector-sub", +[](Cell* args) {                    \
+        return vec_binary(vtype, args, VecSub);                         \
+    }),                                                                 \
+    make_pair(prefix "vector-mul", +[](Cell* args) {                    \
+        return vec_binary(vtype, args, VecMul);                         \
+    }),                                                                 \
+    make_pair(prefix "vector-scale", +[](Cell* args) {                  \
+        return vec_scale(vtype, args);                                  \
+    }),                                                                 \
+    make_pair(prefix "vector-dot", +[](Cell* args) {                    \
+        return vec_dot(vtype, args);                                    \
+    }),                                                                 \
+    make_pair(prefix "vector-sum", +[](Cell* args) {                    \
+        return vec_sum(vtype, args);                                    \
+    }),                                                                 \
+    make_pair(prefix "vector-min", +[](Cell* args) {                    \
+        return vec_extreme(vtype, args, false);                         \
+    }),                                                                 \
+    make_pair(prefix "vector-max", +[](Cell* args) {                    \
+        return vec_extreme(vtype, args, true);                          \
+    })
+
+prim_pairs vector_prims() {
+    return {
+        NUMVECTOR_PRIMS("f64", TypeF64Vector),
+        NUMVECTOR_PRIMS("s64", TypeS64Vector),
+    };
+}
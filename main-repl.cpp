@@ -7,20 +7,46 @@ using namespace std;
 
 #include "lisp.hpp"
 #include "reader.hpp"
+#include "printer.hpp"
+#include "error.hpp"
+#include "port.hpp"
+#include "server.hpp"
+
+int main(int argc, char **argv) {
+    // lisp.out --server path [file ...], see server.hpp
+    if (argc >= 3 && strcmp(argv[1], "--server") == 0) {
+        for (int i = 3; i < argc; i++) {
+            if (!load_file(argv[i])) {
+                perror(argv[i]);
+                return 1;
+            }
+        }
+        return run_server(argv[2]);
+    }
 
-int main() {
     Environment *env = getVM()->root_env;
+    // results may share structure, print it with labels
+    Printer printer(true);
 
     while (true) {
         debuglog("before, %d(%d)\n", getVM()->numObjs(), env->count_obj());
         cout << ";;; Eval input:\n";
-        Cell *exp = lisp_read(stdin);
-        /* exit(1); */
+        Cell *exp = lisp_read(as_port(stdin_port()));
+        if (is_eof_object(exp)) {
+            as_port(stdout_port())->flush();
+            exit(1);
+        }
         cout << "\n";
-        Cell *result = eval(exp, env);
+        Cell *result = eval_toplevel(exp, env);
+        if (is_error(result))
+            errorlog("\n%s", as_error(result)->backtrace().c_str());
 
 
-        cout << ";;; Eval value:\n" << result << "\n";
+        // what the expression wrote to the output port comes first
+        cout.flush();
+        as_port(stdout_port())->flush();
+        printer.write(";;; Eval value:\n").print(result).write("\n");
+        printer.flush(cout);
 
         /* int freed = destroyObject(getVM(), exp); */
         debuglog("after, %d(%d)\n", getVM()->numObjs(), env->count_obj());
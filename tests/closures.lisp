@@ -0,0 +1,14 @@
+(define (make-counter n) (lambda () (set! n (+ n 1)) n))
+(define c (make-counter 10))
+(c)
+(define (adder x) (lambda (y) (+ x y)))
+(define add5 (adder 5))
+(define (grow l n) (if (= n 0) l (grow (append l l) (- n 1))))
+(length (grow (list 1) 18))
+(c)
+(add5 1)
+(define (count-calls n acc) (if (= n 0) acc (count-calls (- n 1) ((adder acc) 1))))
+(count-calls 2000 0)
+(c)
+(atom? c)
+(atom? (list 1))
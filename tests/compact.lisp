@@ -0,0 +1,18 @@
+(define q (quote (a b c d e f)))
+(car (cdr (cdr q)))
+(set-cdr! (cdr q) (list 1 2))
+q
+(set-car! q 0)
+q
+(set-cdr! 5 1)
+(define l (list 1 2 3 4 5 6 7 8))
+(define tail (cdr (cdr (cdr (cdr (cdr l))))))
+(set! l nil)
+(define (grow l n) (if (= n 0) l (grow (append l l) (- n 1))))
+(length (grow (list 1) 18))
+tail
+(define (sorted) (sort (grow (list 3 1 2) 15) <))
+(length (sorted))
+(length (cdr (cdr (sorted))))
+(car (cdr (cdr (sorted))))
+(fold + 0 (sorted))
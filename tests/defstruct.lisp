@@ -0,0 +1,17 @@
+(defstruct point x y)
+(define p (make-point 1 2))
+p
+(point-x p)
+(point-y p)
+(set-point-y! p 20)
+(point-y p)
+(point? p)
+(point? (list 1 2))
+(defstruct line from to label)
+(define l (make-line p (make-point 3 4)))
+l
+(point-x (line-to l))
+(line-label l)
+(point-x l)
+(make-point 1 2 3)
+point-x
@@ -0,0 +1,24 @@
+(future? (define f (future (+ 1 2))))
+(touch f)
+(future-done? f)
+(touch 5)
+(define (pfib n)
+  (if (< n 12)
+      (fib n)
+      (pcall + (pfib (- n 1)) (pfib (- n 2)))))
+(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(define (ffib n)
+  (if (< n 12)
+      (fib n)
+      (begin (define a (future (ffib (- n 1))))
+             (+ (ffib (- n 2)) (touch a)))))
+(pfib 18)
+(ffib 18)
+(pcall list 1 (+ 1 1) (* 3 1))
+(touch (future (car 1)))
+(pcall list 1 (car 2))
+(define (work n) (if (= n 0) 0 (begin (list 1 2 3) (+ 1 (work (- n 1))))))
+(define (grow l n) (if (= n 0) l (grow (append l l) (- n 1))))
+(map touch (map (lambda (i) (future (length (grow (list i) 12)))) (list 1 2 3 4 5 6 7 8)))
+(define (pwork n) (if (< n 10) (work 200) (pcall + (pwork (- n 1)) (pwork (- n 2)))))
+(pwork 18)
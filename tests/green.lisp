@@ -0,0 +1,29 @@
+(define ch (make-channel 2))
+(define (producer n)
+  (if (= n 0)
+      (send ch (quote done))
+      (begin (send ch n) (producer (- n 1)))))
+(define p (spawn (lambda () (producer 5))))
+(define (drain acc)
+  ((lambda (x) (if (eq x (quote done)) (reverse acc) (drain (cons x acc))))
+   (recv ch)))
+(drain nil)
+(join p)
+(green-thread? p)
+(channel? ch)
+(define log (make-channel 100))
+(define (worker id n)
+  (if (= n 0)
+      id
+      (begin (send log (list id n)) (yield) (worker id (- n 1)))))
+(define ts (map (lambda (i) (spawn (lambda () (worker i 3)))) (list 1 2 3)))
+(map join ts)
+(define (collect acc)
+  (if (= (length acc) 9) (reverse acc) (collect (cons (recv log) acc))))
+(collect nil)
+(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(fold + 0 (map join (map (lambda (i) (spawn (lambda () (fib i)))) (list 10 11 12))))
+(join (spawn (lambda () (touch (future (fib 10))))))
+(join (spawn (lambda () (car 1))))
+(recv (make-channel))
+(make-channel 0)
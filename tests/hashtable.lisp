@@ -0,0 +1,20 @@
+(define h (make-equal-hash-table))
+(hash-table-set! h (list 1 2) 12)
+(hash-table-set! h "key" 1.5)
+(hash-table-set! h 100000000000000000000 (quote big))
+(hash-table-ref h (list 1 2))
+(hash-table-ref h "key")
+(hash-table-ref h 100000000000000000000)
+(hash-table-ref h (list 2 1) 0)
+(hash-table-ref h (list 2 1))
+(hash-table-contains? h "key")
+(hash-table-delete! h "key")
+(hash-table-contains? h "key")
+(hash-table-count h)
+(= (equal-hash (list 1 (list 2 3))) (equal-hash (list 1 (list 2 3))))
+(define e (make-eq-hash-table))
+(hash-table-set! e (quote a) 1)
+(hash-table-set! e (list 1) 2)
+(hash-table-ref e (quote a))
+(hash-table-ref e (list 1) (quote missing))
+(hash-table->alist e)
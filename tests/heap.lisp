@@ -0,0 +1,17 @@
+(define (grow l n) (if (= n 0) l (grow (append l l) (- n 1))))
+(heap-limits)
+(set-heap-limits! 1000000 2000000 4000000)
+(heap-limits)
+(length (grow (list 1) 10))
+(try (length (grow (list 1) 20)) (lambda (tag irritant) tag))
+(length (grow (list 1) 10))
+(try (set-heap-limits! 5000000 nil nil) (lambda (msg irritant) msg))
+(set-heap-limits! nil nil 100000000)
+(length (grow (list 1) 18))
+(define (spin n) (if (= n 0) 0 (begin (list 1 2 3) (spin (- n 1)))))
+(define (spins k) (if (= k 0) 0 (begin (spin 500) (spins (- k 1)))))
+(set-heap-limits! 1000000 2000000 16000000)
+(future? (define f (future (spins 200))))
+(try (length (grow (list 1) 20)) (lambda (tag irritant) tag))
+(touch f)
+(length (grow (list 1) 10))
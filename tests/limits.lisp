@@ -0,0 +1,25 @@
+(define (loop n) (loop (+ n 1)))
+(define (count n) (if (= n 0) 0 (+ 1 (count (- n 1)))))
+(define (churn n) (if (= n 0) 0 (begin (list 1 2 3 4) (churn (- n 1)))))
+(with-limits 1000 nil (lambda () (+ 1 2)))
+(with-limits 100 nil (lambda () (count 50)))
+(try (with-limits 100 nil (lambda () (count 200))) (lambda (tag irritant) tag))
+(try (with-limits 1000 nil (lambda () (loop 0))) (lambda (tag irritant) tag))
+(try (with-limits nil 1000 (lambda () (churn 1000))) (lambda (tag irritant) tag))
+(with-limits nil 100000 (lambda () (churn 100)))
+(with-limits 1000 nil
+  (lambda ()
+    (list (try (with-limits 10 nil (lambda () (loop 0)))
+               (lambda (tag irritant) tag))
+          (count 100))))
+(try (with-limits 50 nil (lambda () (with-limits 100000 nil (lambda () (count 100)))))
+     (lambda (tag irritant) tag))
+(try (with-limits -1 nil (lambda () 1)) (lambda (tag irritant) irritant))
+(count 300)
+(try (join (spawn (lambda () (count 100000)))) (lambda (tag irritant) tag))
+(join (spawn (lambda () (count 1000))))
+(define (double s n) (if (= n 0) s (double (string-append s s) (- n 1))))
+(define deep (open-input-string
+              (string-append (double "(" 14) (double ")" 14) " after")))
+(try (join (spawn (lambda () (read deep)))) (lambda (tag irritant) tag))
+(read deep)
@@ -0,0 +1,19 @@
+(append (list 1 2) (list 3) nil (list 4 5))
+(append (list 1) 2)
+(reverse (list 1 2 3))
+(length (list 1 2 3 4))
+(map (lambda (x) (* x x)) (list 1 2 3))
+(map + (list 1 2 3) (list 10 20))
+(map list (list 1 2) (list 3 4))
+(filter (lambda (x) (< x 3)) (list 5 1 4 2 3))
+(fold cons nil (list 1 2 3))
+(fold-right cons nil (list 1 2 3))
+(fold + 0 (list 1 2 3 4))
+(assoc (list 2) (list (cons (list 1) 1) (cons (list 2) 2)))
+(assq (quote b) (list (cons (quote a) 1) (cons (quote b) 2)))
+(member "b" (list "a" "b" "c"))
+(memq (quote c) (list (quote a) (quote b)))
+(sort (list 3 1 2 5 4) <)
+(sort (list (cons 1 (quote a)) (cons 0 (quote b)) (cons 1 (quote c)) (cons 0 (quote d)))
+      (lambda (x y) (< (car x) (car y))))
+(map (lambda (x) (car x)) (list 1 2))
@@ -0,0 +1,21 @@
+(+ 1 2 3)
+(- 10)
+(+ 9223372036854775807 1)
+(- -9223372036854775808 1)
+(* 99999999999 99999999999 99999999999)
+(/ 1 3)
+(+ 1/3 2/3)
+(/ 6 -4)
+(* 2/3 3/4 1.5)
+(quotient 1000000000000000000000000 7)
+(remainder 1000000000000000000000000 7)
+(remainder -7 2)
+(< 1 2 3)
+(< 1 3 2)
+(= 1/2 (/ 2 4))
+(>= 100000000000000000000 99999999999999999999 1/2)
+(define (fact n) (if (< n 2) 1 (* n (fact (- n 1)))))
+(fact 30)
+(quotient (fact 30) (fact 28))
+(/ 1 0)
+(+ 1 (quote a))
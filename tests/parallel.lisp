@@ -0,0 +1,8 @@
+(define v (s64vector 5 3 9 1 7 2 8))
+(parallel-sort! v <)
+(parallel-sort! v (lambda (a b) (> a b)))
+(parallel-map (lambda (x) (* x x)) v)
+(define f (f64vector 2.5 -1 0.5 3))
+(parallel-sort! f >)
+(parallel-map (lambda (x) (/ x 2)) f)
+(parallel-map (lambda (x) (if (= x 7) (car x) x)) v)
@@ -0,0 +1,30 @@
+(define out (open-output-file "/tmp/lisp-ports-test.txt"))
+(display "hello world" out)
+(newline out)
+(write "a \"quoted\" string" out)
+(newline out)
+(write (list 1 2.5 "three" (quote four)) out)
+(newline out)
+(close-port out)
+(define in (open-input-file "/tmp/lisp-ports-test.txt"))
+(read-line in)
+(read in)
+(read in)
+(read in)
+(eof-object? (read-line in))
+(close-port in)
+(define s (open-input-string "abcdef (1 2) ; comment
+  sym"))
+(read-bytes 3 s)
+(read s)
+(read s)
+(read s)
+(eof-object? (read s))
+(read (open-input-string "(1 2"))
+(input-port? s)
+(output-port? (current-output-port))
+(display "to stdout")
+(write "x\ty")
+(read-line (open-input-file "/no/such/file"))
+(define (say n) (if (= n 0) 0 (begin (display "x") (say (- n 1)))))
+(pcall + (say 40) (touch (future (say 40))) (say 40))
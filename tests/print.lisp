@@ -0,0 +1,9 @@
+(list (list 1 2.5) (quote (a (b (c)))) (cons 1 2))
+(define c (list 1 2 3))
+(set-cdr! (cdr (cdr c)) c)
+c
+(define shared (list 4 5))
+(list shared shared)
+(define v (list 1 2))
+(set-car! v v)
+v
@@ -0,0 +1,23 @@
+(define (integers-from n) (cons-stream n (integers-from (+ n 1))))
+(define nat (integers-from 0))
+(stream-car (stream-cdr nat))
+(stream->list nat 5)
+(stream->list (stream-map (lambda (x) (* x x)) nat) 5)
+(stream->list (stream-filter (lambda (x) (< 2 x)) nat) 3)
+(stream->list (stream-take nat 3))
+(stream-ref nat 10)
+(stream-car (stream-drop nat 4))
+(stream-pair? nat)
+(stream-null? (stream-take nat 0))
+(define count 0)
+(define p (delay (begin (set! count (+ count 1)) count)))
+(promise? p)
+(force p)
+(force p)
+count
+(force (make-promise 3))
+(force 4)
+(stream-ref (integers-from 0) 1500000)
+(stream-for-each (lambda (x) (set! count x)) (stream-take nat 3))
+count
+(stream-ref (stream-take nat 2) 5)
@@ -0,0 +1,22 @@
+"hello, world with spaces"
+(string-length "a \"quoted\" word")
+(define long-symbol-name-that-is-well-past-thirty-two-characters 1)
+long-symbol-name-that-is-well-past-thirty-two-characters
+(define s "the quick brown fox jumps over the lazy dog")
+(substring s 4 19)
+(substring s 40)
+(string-length (substring s 4))
+(string-append "foo" (substring s 4 19) "bar")
+(string=? (substring s 4 9) "quick")
+(define sb (make-string-builder))
+(string-builder-append! sb "<li>" 42 "</li>" (quote sym) 1.5)
+(string-builder-length sb)
+(string-builder->string sb)
+(string->symbol (substring s 4 25))
+(symbol->string (quote abc))
+(number->string 3/4)
+(substring s 10 5)
+(define v (substring s 4 25))
+(string->symbol v)
+(try (error v 1) (lambda (tag irritant) (string=? tag v)))
+v
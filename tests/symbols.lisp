@@ -0,0 +1,17 @@
+(define kept (string->symbol "kept-symbol"))
+(define (intern-many n)
+  (if (= n 0) nil (begin (string->symbol (number->string n)) (intern-many (- n 1)))))
+(intern-many 3000)
+(define h (make-eq-hash-table))
+(hash-table-set! h (string->symbol "only-a-key") 1)
+(defstruct point x y)
+(define p (make-point 1 2))
+(define (grow l n) (if (= n 0) l (grow (append l l) (- n 1))))
+(length (grow (list 1) 18))
+(eq kept (string->symbol "kept-symbol"))
+(eq (quote abc) (string->symbol "abc"))
+(hash-table-ref h (string->symbol "only-a-key"))
+(point-y p)
+(set-point-x! p 5)
+(point-x p)
+(symbol->string (string->symbol "3000"))
@@ -0,0 +1,4 @@
+(car (quote x))
+(try (car (quote x)) (lambda (msg irritant) irritant))
+(try (error (quote not-found) 42) (lambda (tag irritant) (list tag irritant)))
+(try (list 1 2) (lambda (tag irritant) tag))
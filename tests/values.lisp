@@ -0,0 +1,22 @@
+(call-with-values (lambda () (values 1 2)) +)
+(call-with-values (lambda () (values 1 2 3)) list)
+(call-with-values (lambda () 5) (lambda (x) (* x x)))
+(call-with-values (lambda () (values)) list)
+(receive (q r) (truncate/ 17 5) (list q r))
+(receive (q r) (truncate/ -17 5) (list q r))
+(receive all (values 1 2) all)
+(receive (x) 7 x)
+(define (split l) (values (car l) (cdr l)))
+(receive (head tail) (split (list 1 2 3)) (cons tail head))
+(values 1 2)
+(values 3)
+(receive (a b) (values 1) a)
+(receive (a) (values 1 2) a)
+(define x (values 1 2))
+(values 3 4 5)
+x
+(list (values 1 2) (values 7 8 9))
+(+ 1 (values 1 2))
+(map (lambda (n) (values n (* n n))) (list 1 2 3))
+(touch (future (values 4 5)))
+(receive (a b) (split (list (values 6 7) 8)) (list a b))
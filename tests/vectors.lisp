@@ -0,0 +1,16 @@
+(f64vector 1 2.5 3)
+(f64vector-dot (f64vector 1 2 3 4 5) (f64vector 5 4 3 2 1))
+(f64vector-add (f64vector 1 2 3 4 5) (f64vector 10 20 30 40 50))
+(f64vector-scale (make-f64vector 5 1.5) 2)
+(f64vector-sum (list->f64vector (list 0.5 0.25 0.125 0.125)))
+(f64vector-min (f64vector 3 -1 4 1 -5 9 2))
+(f64vector-max (f64vector 3 -1 4 1 -5 9 2))
+(s64vector-sub (s64vector 10 20 30) (s64vector 1 2 3))
+(s64vector-sum (s64vector 9223372036854775807 9223372036854775807))
+(s64vector-dot (s64vector 4294967296 4294967296) (s64vector 4294967296 4294967296))
+(s64vector->list (s64vector-mul (s64vector 1 2 3) (s64vector 4 5 6)))
+(define v (make-s64vector 3))
+(s64vector-set! v 1 42)
+v
+(s64vector-ref v 3)
+(make-s64vector 2305843009213693952)